@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// per instance, see InstanceData in mesh.h
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in vec4 aColor;
+layout (location = 8) in vec4 aUVRect;
+out vec4 vertexColor;
+out vec2 texCoord;
+#include "uniforms.glsl"
+#include "meshdecode.glsl"
+void main()
+{
+   vec3 position = decodePosition(aPos);
+   gl_Position = aModel * vec4(position, 1.0);
+   vertexColor = aColor;
+   texCoord = aUVRect.xy + (position.xy + 0.5) * aUVRect.zw;
+}
@@ -0,0 +1,24 @@
+// Unpacks .mesh vertices, see meshfile.h. The Mesh block (uniforms.glsl,
+// include it first) is bound by Mesh::draw(), float meshes get values
+// that change nothing.
+
+vec3 decodePosition(vec3 p)
+{
+   return meshPositionOffset.xyz + p * meshPositionScale.xyz;
+}
+
+vec2 decodeUV(vec2 uv)
+{
+   return meshUVTransform.xy + uv * meshUVTransform.zw;
+}
+
+// Packed normals are octahedral in xy, unfold the lower half.
+vec3 decodeNormal(vec4 n)
+{
+   if (meshPositionScale.w == 0.0)
+      return n.xyz;
+   vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+   float t = max(-v.z, 0.0);
+   v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+   return normalize(v);
+}
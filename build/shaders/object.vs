@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+// same data as instanced.vs, one object per draw call from the Object block
+out vec4 vertexColor;
+out vec2 texCoord;
+#include "uniforms.glsl"
+#include "meshdecode.glsl"
+void main()
+{
+   vec3 position = decodePosition(aPos);
+   gl_Position = objectModel * vec4(position, 1.0);
+   vertexColor = objectColor;
+   texCoord = objectUVRect.xy + (position.xy + 0.5) * objectUVRect.zw;
+}
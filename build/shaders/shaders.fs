@@ -1,8 +1,15 @@
 #version 330 core
 out vec4 FragColor;
 in vec4 vertexColor;
-uniform float ourColor;
+in vec2 texCoord;
+uniform sampler2D sprite; // unit 0, atlas or 1x1 white
+#include "uniforms.glsl"
 void main()
 {
-   FragColor = vec4(ourColor, 0.0f, 0.0f, 1.0f);
+   // cut out transparent sprite pixels, there is no blending
+   vec4 texel = texture(sprite, texCoord);
+   if (texel.a < materialParams.x)
+      discard;
+   // the material tint pulses the brightness over time
+   FragColor = texel * vertexColor * materialTint;
 }
@@ -0,0 +1,145 @@
+#include "batch.h"
+#include "glstate.h"
+
+#include <stddef.h>
+#include <string.h>
+
+QuadBatch::QuadBatch(unsigned int quadsPerRegion, unsigned int regionCount) {
+    if (quadsPerRegion == 0 || quadsPerRegion > MAX_QUADS_PER_REGION)
+        quadsPerRegion = MAX_QUADS_PER_REGION;
+    if (regionCount == 0)
+        regionCount = 1;
+    this->quadsPerRegion = quadsPerRegion;
+    this->drawCalls = 0;
+    this->quadCount = 0;
+    pending.reserve(quadsPerRegion * 4);
+
+    glGenVertexArrays(1, &VAO);
+    GLState::bindVertexArray(VAO);
+
+    // Storage only, contents are streamed in flush().
+    vertices = new UploadRing(GL_ARRAY_BUFFER, (size_t)quadsPerRegion * regionCount * 4 * sizeof(QuadVertex));
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vertices->buffer());
+
+    // Every quad is two triangles over its own four corners, so one index
+    // pattern covers a whole region. It never changes.
+    std::vector<unsigned short> indices(quadsPerRegion * 6);
+    for (unsigned int q = 0; q < quadsPerRegion; q++) {
+        unsigned short base = (unsigned short)(q * 4);
+        unsigned short *i = &indices[q * 6];
+        i[0] = base + 0; i[1] = base + 1; i[2] = base + 2; // Triangle 1
+        i[3] = base + 2; i[4] = base + 3; i[5] = base + 0; // Triangle 2
+    }
+    glGenBuffers(1, &EBO);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), indices.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(QuadVertex), (void*)offsetof(QuadVertex, x));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(QuadVertex), (void*)offsetof(QuadVertex, r));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuadVertex), (void*)offsetof(QuadVertex, u));
+    glEnableVertexAttribArray(2);
+
+    GLState::bindVertexArray(0);
+}
+
+QuadBatch::~QuadBatch() {
+    GLState::deleteVertexArrays(1, &VAO);
+    delete vertices;
+    GLState::deleteBuffers(1, &EBO);
+}
+
+void QuadBatch::begin() {
+    pending.clear();
+    drawCalls = 0;
+    quadCount = 0;
+}
+
+void QuadBatch::makeQuad(QuadVertex out[4], float x, float y, float w, float h, const float color[4]) {
+    static const float full[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+    makeQuad(out, x, y, w, h, color, full);
+}
+
+// 0..1 to a normalized integer with max as 1, clamped.
+static inline unsigned int unorm(float f, float max) {
+    f = f < 0.0f ? 0.0f : f > 1.0f ? 1.0f : f;
+    return (unsigned int)(f * max + 0.5f);
+}
+
+void QuadBatch::makeQuad(QuadVertex out[4], float x, float y, float w, float h, const float color[4], const float uv[4]) {
+    unsigned char r = (unsigned char)unorm(color[0], 255.0f);
+    unsigned char g = (unsigned char)unorm(color[1], 255.0f);
+    unsigned char b = (unsigned char)unorm(color[2], 255.0f);
+    unsigned char a = (unsigned char)unorm(color[3], 255.0f);
+    unsigned short u0 = (unsigned short)unorm(uv[0], 65535.0f), v0 = (unsigned short)unorm(uv[1], 65535.0f);
+    unsigned short u1 = (unsigned short)unorm(uv[2], 65535.0f), v1 = (unsigned short)unorm(uv[3], 65535.0f);
+    QuadVertex corners[4] = {
+        { x,     y,     0.0f, r, g, b, a, u0, v0 },
+        { x + w, y,     0.0f, r, g, b, a, u1, v0 },
+        { x + w, y + h, 0.0f, r, g, b, a, u1, v1 },
+        { x,     y + h, 0.0f, r, g, b, a, u0, v1 },
+    };
+    memcpy(out, corners, sizeof(corners));
+}
+
+void QuadBatch::drawQuad(float x, float y, float w, float h, const float color[4]) {
+    QuadVertex corners[4];
+    makeQuad(corners, x, y, w, h, color);
+    drawQuad(corners);
+}
+
+void QuadBatch::drawQuad(const QuadVertex corners[4]) {
+    if (pending.size() >= (size_t)quadsPerRegion * 4)
+        flush();
+    pending.insert(pending.end(), corners, corners + 4);
+    quadCount++;
+}
+
+void QuadBatch::drawQuads(const QuadVertex *corners, size_t quads) {
+    // Region sized chunks, same as calling drawQuad() for each.
+    while (quads > 0) {
+        size_t room = (size_t)quadsPerRegion - pending.size() / 4;
+        if (room == 0) {
+            flush();
+            continue;
+        }
+        size_t n = quads < room ? quads : room;
+        pending.insert(pending.end(), corners, corners + n * 4);
+        quadCount += (unsigned int)n;
+        corners += n * 4;
+        quads -= n;
+    }
+}
+
+void QuadBatch::flush() {
+    if (pending.empty())
+        return;
+
+    unsigned int quads = (unsigned int)(pending.size() / 4);
+    size_t bytes = pending.size() * sizeof(QuadVertex);
+
+    // Aligned to whole vertices, so the offset works as a base vertex.
+    size_t offset = 0;
+    GLState::bindVertexArray(VAO);
+    void *dst = vertices->map(bytes, sizeof(QuadVertex), offset);
+    if (dst) {
+        memcpy(dst, pending.data(), bytes);
+        vertices->unmap();
+    } else {
+        // Only when mapping itself failed, the ring still kept the range
+        // free for us.
+        GLState::bindBuffer(GL_ARRAY_BUFFER, vertices->buffer());
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)offset, (GLsizeiptr)bytes, pending.data());
+    }
+
+    glDrawElementsBaseVertex(GL_TRIANGLES, quads * 6, GL_UNSIGNED_SHORT, 0, (GLint)(offset / sizeof(QuadVertex)));
+
+    drawCalls++;
+    pending.clear();
+}
+
+void QuadBatch::end() {
+    flush();
+    vertices->endFrame();
+}
@@ -0,0 +1,79 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+#include <vector>
+
+#include "uploadring.h"
+
+// One corner of a quad as it sits in the vertex buffer, 20 bytes.
+// Attribute locations: 0 = position, 1 = color, 2 = texture coordinates.
+// Color and uv are normalized integers (GL turns them back into 0..1),
+// these get streamed every frame so every byte counts.
+struct QuadVertex {
+    float x, y, z;
+    unsigned char r, g, b, a;
+    unsigned short u, v;
+};
+
+/*
+Collects quads on the CPU and streams them to the GPU in big chunks.
+
+Vertices go into an UploadRing of regionCount regions. Each flush
+copies the pending quads to the next free bytes of the ring and end()
+fences the frame, so the ring only waits when the GPU is really behind
+(vertices.stats counts it), the driver never has to. Quads all share
+one static index buffer, each draw picks its bytes with a base vertex.
+
+Size the ring for three frames: a frame that flushes more than
+regionCount full regions has to wait for its own first draws.
+*/
+class QuadBatch {
+public:
+    // Quads per region, also the most one draw call can take. 16 bit
+    // indices limit this to 16384 (65536 vertices).
+    static const unsigned int MAX_QUADS_PER_REGION = 16384;
+
+    QuadBatch(unsigned int quadsPerRegion = MAX_QUADS_PER_REGION, unsigned int regionCount = 3);
+    ~QuadBatch();
+
+    // Start a frame, resets the counters.
+    void begin();
+    // Axis aligned quad, (x, y) is the bottom left corner.
+    void drawQuad(float x, float y, float w, float h, const float color[4]);
+    // Arbitrary quad, corners in counter clockwise order.
+    void drawQuad(const QuadVertex corners[4]);
+    // Many quads recorded earlier, 4 corners each.
+    void drawQuads(const QuadVertex *corners, size_t quads);
+    // Corners of an axis aligned quad, for recording without a batch
+    // (e.g. on a thread with no GL context).
+    static void makeQuad(QuadVertex out[4], float x, float y, float w, float h, const float color[4]);
+    // Same, textured with uv = (u0, v0, u1, v1), e.g. a sprite in an atlas.
+    // uv is clamped to 0..1, there is no repeat.
+    static void makeQuad(QuadVertex out[4], float x, float y, float w, float h, const float color[4], const float uv[4]);
+    // Upload and draw everything pending. Called automatically when a
+    // region fills up, call it yourself before changing shader or state.
+    void flush();
+    // Same as flush(), marks the end of the frame.
+    void end();
+
+    // Stats for the current frame.
+    unsigned int drawCalls;
+    unsigned int quadCount;
+
+    // Stalls and bytes, since creation.
+    const UploadRing::Stats &uploadStats() const { return vertices->stats; }
+
+private:
+    unsigned int VAO, EBO;
+    UploadRing *vertices;
+    unsigned int quadsPerRegion;
+    std::vector<QuadVertex> pending;
+
+    QuadBatch(const QuadBatch&) = delete;
+    QuadBatch& operator=(const QuadBatch&) = delete;
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <math.h>
+#include <vector>
+
+#include "benchmark.h"
+#include "geometryheap.h"
+#include "glstate.h"
+#include "headless.h"
+#include "loader.h"
+#include "mesh.h"
+#include "multidraw.h"
+#include "shader.h"
+#include "uniforms.h"
+#include "vecmath.h"
+
+// Lay count quads out on a square grid covering the screen.
+static void buildInstances(std::vector<InstanceData> &instances, size_t count) {
+    int side = (int)ceil(sqrt((double)count));
+    float cell = 2.0f / side;
+    float scale = cell * 0.8f;
+
+    instances.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        int col = (int)(i % side);
+        int row = (int)(i / side);
+        InstanceData &d = instances[i];
+        // scale, then translate to the cell center
+        mat4 model = mat4::translate({ -1.0f + (col + 0.5f) * cell, -1.0f + (row + 0.5f) * cell, 0.0f })
+                   * mat4::scale({ scale, scale, 1.0f });
+        for (int k = 0; k < 16; k++)
+            d.model[k] = model.m[k];
+        d.color[0] = (float)col / side;
+        d.color[1] = (float)row / side;
+        d.color[2] = 0.5f;
+        d.color[3] = 1.0f;
+        d.uvRect[0] = 0.0f;
+        d.uvRect[1] = 0.0f;
+        d.uvRect[2] = 1.0f;
+        d.uvRect[3] = 1.0f;
+    }
+}
+
+// The mesh shaders #include meshdecode.glsl, expand it the way the
+// loader does.
+static bool buildShader(Shader &shader, const char *vertexPath, const char *fragmentPath) {
+    std::string vertexCode, fragmentCode;
+    return Shader::preprocess(vertexPath, vertexCode)
+        && Shader::preprocess(fragmentPath, fragmentCode)
+        && shader.build(vertexCode, fragmentCode);
+}
+
+// Per object draws push InstanceData straight into the Object block.
+static_assert(sizeof(InstanceData) == sizeof(ObjectUniforms) && offsetof(InstanceData, color) == offsetof(ObjectUniforms, color)
+              && offsetof(InstanceData, uvRect) == offsetof(ObjectUniforms, uvRect), "InstanceData must match ObjectUniforms");
+
+struct BenchResult {
+    double submitMs; // CPU time spent issuing the draws
+    double frameMs;  // whole frame including swap
+    int frames;      // measured, fewer than planned if the window closed
+};
+
+void runInstancingBenchmark(GLFWwindow *window, HeadlessContext *headless) {
+    typedef std::chrono::steady_clock Clock;
+    const size_t counts[] = { 1000, 10000, 100000 };
+    const int WARMUP_FRAMES = 10;
+
+    Shader objectShader, instancedShader;
+    if (!buildShader(objectShader, "build/shaders/object.vs", "build/shaders/shaders.fs")
+        || !buildShader(instancedShader, "build/shaders/instanced.vs", "build/shaders/shaders.fs"))
+        return;
+
+    // Converted from src/meshes/quad.obj by make, see meshfile.h.
+    MeshFile quadFile;
+    if (!quadFile.open("build/meshes/quad.mesh") || !quadFile.verify(0))
+        return;
+    Mesh *quad = new Mesh(quadFile, 0);
+    // The per object mode draws a copy out of a GeometryHeap, the way
+    // meshes share buffers. Instancing needs the quad's own VAO.
+    const MeshFileHeader &header = quadFile.header();
+    GeometryHeap *heap = new GeometryHeap(header.vertexStride,
+                                          header.vertexFormat == MESH_VERTEX_PACKED ? Mesh::PACKED_LAYOUT : Mesh::FILE_LAYOUT,
+                                          3, quadFile.lod(0).indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+                                          1 << 20, 1 << 20);
+    Mesh *sharedQuad = new Mesh(quadFile, 0, heap);
+    quad->enableInstancing(counts[2]);
+
+    // shaders.fs samples unit 0, white leaves the colors alone.
+    unsigned int white;
+    const unsigned char pixel[4] = { 255, 255, 255, 255 };
+    glGenTextures(1, &white);
+    GLState::bindTexture(0, GL_TEXTURE_2D, white);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Plain white material for both programs, bound once. Per object
+    // blocks are streamed, one upload per batch and a range bind per draw.
+    UniformBuffer material;
+    MaterialUniforms m = { { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.5f, 0.0f, 0.0f, 0.0f } };
+    material.update(m);
+    material.bind(UBO_MATERIAL);
+    UniformStream objects;
+    std::vector<size_t> offsets(counts[2]);
+
+    // Same instances again as one command each, picked by baseInstance.
+    // Run through the best path the driver has and through the plain
+    // loop, to see what the multi-draw saves.
+    MultiDraw multiDraw(counts[2]);
+    multiDraw.setInstanceLayout(quad->instanceBuffer(), sizeof(InstanceData), Mesh::INSTANCE_ATTRIBUTES, 6);
+    MultiDraw::Path bestPath = MultiDraw::best();
+    const int PER_OBJECT = 0, INSTANCED = 1, MULTI_BEST = 2, MULTI_LOOP = 3;
+
+    // No vsync, we want to see the CPU cost, not the display rate.
+    if (window)
+        glfwSwapInterval(0);
+
+    std::vector<InstanceData> instances;
+    std::cout << std::setw(10) << "instances" << std::setw(14) << "mode"
+              << std::setw(14) << "submit ms" << std::setw(14) << "frame ms" << std::endl;
+
+    for (size_t count : counts) {
+        buildInstances(instances, count);
+        // Fewer frames for the big runs, per object drawing gets slow.
+        int frames = (int)(2000000 / count);
+        if (frames > 200) frames = 200;
+        if (frames < 10) frames = 10;
+
+        for (int mode = PER_OBJECT; mode <= MULTI_LOOP; mode++) {
+            multiDraw.path = mode == MULTI_LOOP ? MultiDraw::PATH_LOOP : bestPath;
+            BenchResult result = { 0.0, 0.0, 0 };
+            for (int frame = 0; frame < WARMUP_FRAMES + frames; frame++) {
+                if (window && glfwWindowShouldClose(window))
+                    break;
+                Clock::time_point start = Clock::now();
+                glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+
+                if (mode == INSTANCED) {
+                    instancedShader.use();
+                    quad->drawInstanced(instances.data(), count);
+                } else if (mode == MULTI_BEST || mode == MULTI_LOOP) {
+                    instancedShader.use();
+                    size_t n = quad->uploadInstances(instances.data(), count);
+                    for (size_t i = 0; i < n; i++)
+                        multiDraw.add(quad->indices(), quad->firstIndex(), quad->baseVertex(), 1, (GLuint)i);
+                    quad->bindDecode();
+                    GLState::bindVertexArray(quad->VAO);
+                    multiDraw.submit(GL_TRIANGLES, quad->indexFormat());
+                } else {
+                    objectShader.use();
+                    for (size_t i = 0; i < count; ) {
+                        size_t first = i;
+                        objects.reset();
+                        while (i < count && objects.push(&instances[i], sizeof(ObjectUniforms), offsets[i]))
+                            i++;
+                        objects.upload();
+                        for (size_t k = first; k < i; k++) {
+                            objects.bind(UBO_OBJECT, offsets[k], sizeof(ObjectUniforms));
+                            sharedQuad->draw();
+                        }
+                    }
+                    objects.endFrame();
+                }
+                Clock::time_point submitted = Clock::now();
+
+                if (window) {
+                    glfwSwapBuffers(window);
+                    glfwPollEvents();
+                } else {
+                    headless->present();
+                }
+                Clock::time_point end = Clock::now();
+
+                if (frame >= WARMUP_FRAMES) {
+                    result.submitMs += std::chrono::duration<double, std::milli>(submitted - start).count();
+                    result.frameMs += std::chrono::duration<double, std::milli>(end - start).count();
+                    result.frames++;
+                }
+            }
+            if (result.frames == 0)
+                continue; // closed before anything was measured
+            const char *name = mode == PER_OBJECT ? "per-object" : mode == INSTANCED ? "instanced"
+                             : MultiDraw::pathName(multiDraw.stats.path);
+            std::cout << std::setw(10) << count << std::setw(14) << name
+                      << std::fixed << std::setprecision(3)
+                      << std::setw(14) << result.submitMs / result.frames
+                      << std::setw(14) << result.frameMs / result.frames << std::endl;
+        }
+    }
+
+    // Not timed: fill the heap with copies, free every other one and
+    // compact. The last copies move down into the holes.
+    std::vector<Mesh*> copies(64);
+    for (Mesh *&copy : copies)
+        copy = new Mesh(quadFile, 0, heap);
+    quadFile.close();
+    for (size_t i = 0; i < copies.size(); i += 2) {
+        delete copies[i];
+        copies[i] = NULL;
+    }
+    heap->report(std::cout);
+    while (heap->defragment() > 0) {}
+    heap->report(std::cout);
+    for (Mesh *copy : copies)
+        delete copy;
+
+    GLState::deleteTextures(1, &white);
+    delete sharedQuad;
+    delete heap;
+    delete quad;
+}
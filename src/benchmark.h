@@ -0,0 +1,16 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <GLFW/glfw3.h>
+
+class HeadlessContext;
+
+// Draws 1k, 10k and 100k quads, first with one draw call per object,
+// then with a single instanced call, then as one MultiDraw command per
+// quad (best path, then the draw loop), and prints the CPU frame time
+// of each. Run with: ./build/game --bench-instancing
+// Pass either the window or, with --headless, the context whose FBO it
+// draws into. Headless frames end in a flush instead of a swap.
+void runInstancingBenchmark(GLFWwindow *window, HeadlessContext *headless);
+
+#endif
@@ -0,0 +1,43 @@
+#include "ecs.h"
+
+unsigned int World::nextTypeId() {
+    static std::atomic<unsigned int> next(0);
+    return next++;
+}
+
+Entity World::create() {
+    uint32_t idx;
+    if (!freeList.empty()) {
+        idx = freeList.back();
+        freeList.pop_back();
+    } else {
+        if (generations.size() >= MAX_ENTITIES)
+            return NULL_ENTITY;
+        idx = (uint32_t)generations.size();
+        generations.push_back(0);
+        // Every slot can end up on the free list, make room now so the
+        // first destroy() after spawning isn't the one that allocates.
+        if (freeList.capacity() < generations.capacity())
+            freeList.reserve(generations.capacity());
+    }
+    live++;
+    return (generations[idx] << ENTITY_INDEX_BITS) | idx;
+}
+
+void World::destroy(Entity e) {
+    if (!alive(e))
+        return;
+    uint32_t idx = index(e);
+    for (size_t i = 0; i < pools.size(); i++)
+        if (pools[i])
+            pools[i]->remove(idx);
+    // Generation only has the bits above the index, wraps around.
+    generations[idx] = (generations[idx] + 1) & (0xffffffffu >> ENTITY_INDEX_BITS);
+    freeList.push_back(idx);
+    live--;
+}
+
+bool World::alive(Entity e) const {
+    uint32_t idx = index(e);
+    return e != NULL_ENTITY && idx < generations.size() && (generations[idx] << ENTITY_INDEX_BITS | idx) == e;
+}
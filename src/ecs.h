@@ -0,0 +1,196 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <tuple>
+#include <vector>
+
+#include "jobs.h"
+
+/*
+Entities and components, sparse set storage.
+
+An Entity is just an id: low ENTITY_INDEX_BITS bits are a slot index, the rest
+is that slot's generation. destroy() bumps the generation and puts the
+slot on a free list, so create/destroy are O(1) with no allocation once
+warm, and a stale id to a reused slot is caught by alive().
+
+Every component type has its own pool. A pool keeps its components
+packed in one array (data) with the owning entities in a second,
+parallel array (entities); a sparse array maps entity index to position.
+So each component type is its own contiguous stream (structure of
+arrays across components), iterating a pool never chases a pointer, and
+removing swaps the last element into the hole.
+
+Systems use each<A, B, ...>(fn) or parallelEach, which walk A's array
+and look the others up. Put the rarest component first. Adding or
+removing components while iterating is not allowed, collect the
+entities and do it afterwards.
+*/
+typedef uint32_t Entity;
+
+const Entity NULL_ENTITY = 0xffffffffu;
+const int ENTITY_INDEX_BITS = 20; // about a million live entities
+const uint32_t ENTITY_INDEX_MASK = (1u << ENTITY_INDEX_BITS) - 1;
+
+class ComponentPoolBase {
+public:
+    virtual ~ComponentPoolBase() {}
+    virtual void remove(uint32_t index) = 0;
+};
+
+template <typename T>
+class ComponentPool : public ComponentPoolBase {
+public:
+    static constexpr uint32_t NONE = 0xffffffffu;
+
+    bool has(uint32_t index) const { return index < sparse.size() && sparse[index] != NONE; }
+    T &get(uint32_t index) { return data[sparse[index]]; }
+
+    T &add(Entity e, uint32_t index, const T &value) {
+        if (index >= sparse.size())
+            sparse.resize(index + 1, NONE);
+        if (sparse[index] != NONE)
+            return data[sparse[index]] = value;
+        sparse[index] = (uint32_t)data.size();
+        entities.push_back(e);
+        data.push_back(value);
+        return data.back();
+    }
+
+    void remove(uint32_t index) {
+        if (!has(index))
+            return;
+        uint32_t hole = sparse[index];
+        uint32_t last = (uint32_t)data.size() - 1;
+        if (hole != last) {
+            data[hole] = data[last];
+            entities[hole] = entities[last];
+            sparse[entities[hole] & ENTITY_INDEX_MASK] = hole;
+        }
+        data.pop_back();
+        entities.pop_back();
+        sparse[index] = NONE;
+    }
+
+    size_t size() const { return data.size(); }
+
+    // Packed and in the same order, i-th component belongs to entities[i].
+    std::vector<Entity> entities;
+    std::vector<T> data;
+
+private:
+    std::vector<uint32_t> sparse;
+};
+
+class World {
+public:
+    // The last index would make NULL_ENTITY.
+    static const uint32_t MAX_ENTITIES = ENTITY_INDEX_MASK;
+
+    World() : live(0) {}
+
+    // NULL_ENTITY when MAX_ENTITIES are alive.
+    Entity create();
+    // Removes all its components. Stale or null ids are ignored.
+    void destroy(Entity e);
+    bool alive(Entity e) const;
+    size_t entityCount() const { return live; }
+
+    static uint32_t index(Entity e) { return e & ENTITY_INDEX_MASK; }
+
+    template <typename T>
+    T &add(Entity e, const T &value = T()) { return pool<T>().add(e, index(e), value); }
+    template <typename T>
+    void remove(Entity e) { if (alive(e)) pool<T>().remove(index(e)); }
+    template <typename T>
+    bool has(Entity e) const;
+    // Null if it doesn't have one.
+    template <typename T>
+    T *get(Entity e);
+
+    // The pool itself, for raw spans. Created on first use.
+    template <typename T>
+    ComponentPool<T> &pool();
+
+    // fn(Entity, First&, Rest&...) for every entity that has them all.
+    template <typename First, typename... Rest, typename F>
+    void each(F fn);
+    // Same, First's array is split over the job system. fn runs on
+    // several threads at once and may only touch the entity it's given.
+    template <typename First, typename... Rest, typename F>
+    void parallelEach(JobSystem &jobs, size_t grain, F fn);
+
+private:
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> freeList;
+    std::vector<std::unique_ptr<ComponentPoolBase> > pools;
+    size_t live;
+
+    static unsigned int nextTypeId();
+    template <typename T>
+    static unsigned int typeId() {
+        static const unsigned int id = nextTypeId();
+        return id;
+    }
+
+    template <typename F, typename First, typename... Rest>
+    static void eachRange(size_t begin, size_t end, F &fn, ComponentPool<First> &first, ComponentPool<Rest> &...rest);
+};
+
+template <typename T>
+ComponentPool<T> &World::pool() {
+    unsigned int id = typeId<T>();
+    if (id >= pools.size())
+        pools.resize(id + 1);
+    if (!pools[id])
+        pools[id].reset(new ComponentPool<T>());
+    return *(ComponentPool<T>*)pools[id].get();
+}
+
+template <typename T>
+bool World::has(Entity e) const {
+    unsigned int id = typeId<T>();
+    if (!alive(e) || id >= pools.size() || !pools[id])
+        return false;
+    return ((const ComponentPool<T>*)pools[id].get())->has(index(e));
+}
+
+template <typename T>
+T *World::get(Entity e) {
+    if (!alive(e))
+        return NULL;
+    ComponentPool<T> &p = pool<T>();
+    return p.has(index(e)) ? &p.get(index(e)) : NULL;
+}
+
+template <typename F, typename First, typename... Rest>
+void World::eachRange(size_t begin, size_t end, F &fn, ComponentPool<First> &first, ComponentPool<Rest> &...rest) {
+    for (size_t i = begin; i < end; i++) {
+        Entity e = first.entities[i];
+        // Unused when First is the only pool.
+        [[maybe_unused]] uint32_t idx = index(e);
+        if ((rest.has(idx) && ...))
+            fn(e, first.data[i], rest.get(idx)...);
+    }
+}
+
+template <typename First, typename... Rest, typename F>
+void World::each(F fn) {
+    eachRange(0, pool<First>().size(), fn, pool<First>(), pool<Rest>()...);
+}
+
+template <typename First, typename... Rest, typename F>
+void World::parallelEach(JobSystem &jobs, size_t grain, F fn) {
+    // Look the pools up here, creating one from a job would race.
+    ComponentPool<First> &first = pool<First>();
+    std::tuple<ComponentPool<Rest>*...> rest(&pool<Rest>()...);
+    jobs.parallelFor(first.size(), grain, [&](size_t begin, size_t end) {
+        std::apply([&](ComponentPool<Rest> *...r) { eachRange(begin, end, fn, first, *r...); }, rest);
+    });
+}
+
+#endif
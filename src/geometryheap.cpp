@@ -0,0 +1,156 @@
+#include "geometryheap.h"
+#include "glstate.h"
+
+#include <iostream>
+
+static size_t indexBytesOf(GLenum indexType) {
+    return indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+GeometryHeap::GeometryHeap(GLsizei stride, const VertexAttribute *attributes, size_t attributeCount, GLenum indexType,
+                           size_t vertexBytes, size_t indexBytes)
+    : layout(attributes, attributes + attributeCount),
+      vertexRanges(vertexBytes / (stride > 0 ? stride : 1)), indexRanges(indexBytes / indexBytesOf(indexType)) {
+    this->stride = stride;
+    this->indexType = indexType;
+    this->moves = 0;
+    this->movedBytes = 0;
+
+    glGenVertexArrays(1, &VAO);
+    GLState::bindVertexArray(VAO);
+
+    // Storage only, meshes are copied in by add().
+    glGenBuffers(1, &VBO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexRanges.capacity() * stride, NULL, GL_STATIC_DRAW);
+    glGenBuffers(1, &EBO);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexRanges.capacity() * indexSize(), NULL, GL_STATIC_DRAW);
+
+    for (const VertexAttribute &a : layout) {
+        glVertexAttribPointer(a.location, a.size, a.type, a.normalized, stride, (void*)a.offset);
+        glEnableVertexAttribArray(a.location);
+    }
+
+    GLState::bindVertexArray(0);
+}
+
+GeometryHeap::~GeometryHeap() {
+    // Meshes still in here are the owner's bug, their ranges just go.
+    GLState::deleteVertexArrays(1, &VAO);
+    GLState::deleteBuffers(1, &VBO);
+    GLState::deleteBuffers(1, &EBO);
+}
+
+bool GeometryHeap::accepts(GLsizei stride, const VertexAttribute *attributes, size_t attributeCount,
+                           GLenum indexType) const {
+    if (stride != this->stride || indexType != this->indexType || attributeCount != layout.size())
+        return false;
+    for (size_t i = 0; i < attributeCount; i++) {
+        const VertexAttribute &a = attributes[i], &b = layout[i];
+        if (a.location != b.location || a.size != b.size || a.type != b.type ||
+            a.normalized != b.normalized || a.offset != b.offset)
+            return false;
+    }
+    return true;
+}
+
+GeometryRange *GeometryHeap::add(const void *vertices, size_t vertexCount, const void *indices, size_t indexCount) {
+    RangeAllocator::Block *v = vertexRanges.allocate(vertexCount);
+    RangeAllocator::Block *i = v ? indexRanges.allocate(indexCount) : NULL;
+    if (!i) {
+        vertexRanges.free(v);
+        std::cout << "ERROR::GEOMETRY_HEAP::OUT_OF_SPACE " << vertexCount << " vertices, "
+                  << indexCount << " indices" << std::endl;
+        return NULL;
+    }
+    GeometryRange *range = ranges.create();
+    range->vertices = v;
+    range->indices = i;
+    v->user = range;
+    i->user = range;
+
+    // Through the copy target, the element array binding belongs to
+    // whatever VAO is bound.
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, v->offset * stride, vertexCount * stride, vertices);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, i->offset * indexSize(), indexCount * indexSize(), indices);
+    return range;
+}
+
+void GeometryHeap::remove(GeometryRange *range) {
+    if (!range)
+        return;
+    vertexRanges.free(range->vertices);
+    indexRanges.free(range->indices);
+    ranges.destroy(range);
+}
+
+size_t GeometryHeap::defragment(size_t budget) {
+    size_t moved = 0;
+    bool vertexDone = false, indexDone = false;
+    while (moved < budget && !(vertexDone && indexDone)) {
+        if (!vertexDone)
+            vertexDone = !compact(vertexRanges, VBO, stride, true, moved);
+        if (!indexDone && moved < budget)
+            indexDone = !compact(indexRanges, EBO, indexSize(), false, moved);
+    }
+    return moved;
+}
+
+// Moves the last mesh of one buffer into the lowest free range that
+// fits. False when there's none below it.
+bool GeometryHeap::compact(RangeAllocator &allocator, unsigned int buffer, size_t unit, bool vertices, size_t &moved) {
+    RangeAllocator::Block *top = allocator.highest();
+    if (!top)
+        return false;
+    RangeAllocator::Block *to = allocator.allocateLowest(top->size, top->offset);
+    if (!to)
+        return false;
+
+    // A free range and a used one never overlap, so copying inside the
+    // same buffer is fine. GL orders it with the draws around it.
+    GLState::bindBuffer(GL_COPY_READ_BUFFER, buffer);
+    GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, top->offset * unit, to->offset * unit, top->size * unit);
+
+    GeometryRange *range = (GeometryRange*)top->user;
+    to->user = range;
+    if (vertices)
+        range->vertices = to;
+    else
+        range->indices = to;
+    allocator.free(top);
+
+    moved += to->size * unit;
+    moves++;
+    movedBytes += to->size * unit;
+    return true;
+}
+
+GeometryHeap::Stats GeometryHeap::stats() const {
+    Stats s;
+    s.meshes = ranges.liveCount();
+    s.vertexBytes = vertexRanges.capacity() * stride;
+    s.vertexUsed = vertexRanges.used() * stride;
+    s.indexBytes = indexRanges.capacity() * indexSize();
+    s.indexUsed = indexRanges.used() * indexSize();
+    s.vertexLargestFree = vertexRanges.largestFree() * stride;
+    s.indexLargestFree = indexRanges.largestFree() * indexSize();
+    s.holes = vertexRanges.freeRanges() + indexRanges.freeRanges();
+    s.moves = moves;
+    s.movedBytes = movedBytes;
+    return s;
+}
+
+void GeometryHeap::report(std::ostream &out) const {
+    Stats s = stats();
+    double vertexPercent = s.vertexBytes ? 100.0 * s.vertexUsed / s.vertexBytes : 0.0;
+    double indexPercent = s.indexBytes ? 100.0 * s.indexUsed / s.indexBytes : 0.0;
+    out << "Geometry heap: " << s.meshes << " meshes, vertices " << vertexPercent << "% of "
+        << s.vertexBytes / 1024 << " KB, indices " << indexPercent << "% of " << s.indexBytes / 1024
+        << " KB, " << s.holes << " free ranges (largest " << s.vertexLargestFree / 1024 << " / "
+        << s.indexLargestFree / 1024 << " KB), " << s.moves << " moves (" << s.movedBytes / 1024
+        << " KB)" << std::endl;
+}
@@ -0,0 +1,89 @@
+#ifndef GEOMETRYHEAP_H
+#define GEOMETRYHEAP_H
+
+#include <glad/glad.h>
+
+#include <ostream>
+#include <stddef.h>
+#include <vector>
+
+#include "memory.h"
+#include "mesh.h"
+
+// Where one mesh sits in a GeometryHeap. defragment() can move it, so
+// read the offsets when drawing, don't keep them.
+struct GeometryRange {
+    RangeAllocator::Block *vertices;  // in vertices
+    RangeAllocator::Block *indices;   // in indices
+
+    GLint baseVertex() const { return (GLint)vertices->offset; }
+    GLuint firstIndex() const { return (GLuint)indices->offset; }
+    GLsizei indexCount() const { return (GLsizei)indices->size; }
+};
+
+/*
+One big vertex buffer and one big index buffer shared by many meshes of
+the same vertex layout, with one VAO over both. Each mesh gets a range
+of each (RangeAllocator, in vertices and indices, so everything is
+aligned for free) and draws with glDrawElementsBaseVertex: its indices
+stay relative to its own first vertex, 16 bit indices keep working for
+meshes up to 65536 vertices whatever their place in the buffer.
+
+Every mesh in the heap draws with the same VAO and buffers, so switching
+meshes binds nothing, and a MultiDraw can draw any mix of them in one
+call (firstIndex and baseVertex per command).
+
+Sizes are fixed at creation, add() returns NULL when a buffer is full
+(or too fragmented for the mesh). defragment() moves the mesh at the far
+end into the lowest free range that fits, with glCopyBufferSubData on
+the GPU, a budget's worth per call, so free space gathers at the end.
+Call it once a frame or after unloading a batch of meshes.
+*/
+class GeometryHeap {
+public:
+    GeometryHeap(GLsizei stride, const VertexAttribute *attributes, size_t attributeCount, GLenum indexType,
+                 size_t vertexBytes = 32 << 20, size_t indexBytes = 16 << 20);
+    ~GeometryHeap();
+
+    // Whether meshes of this layout can go in.
+    bool accepts(GLsizei stride, const VertexAttribute *attributes, size_t attributeCount, GLenum indexType) const;
+
+    // Uploads a mesh, NULL when there's no room.
+    GeometryRange *add(const void *vertices, size_t vertexCount, const void *indices, size_t indexCount);
+    void remove(GeometryRange *range);
+
+    // Moves meshes toward the start until at least budget bytes have
+    // been copied or nothing more can move down. Bytes copied.
+    size_t defragment(size_t budget = 256 * 1024);
+
+    unsigned int VAO;
+    GLenum indexFormat() const { return indexType; }
+    size_t indexSize() const { return indexType == GL_UNSIGNED_SHORT ? 2 : 4; }
+
+    struct Stats {
+        size_t meshes;
+        size_t vertexBytes, vertexUsed;
+        size_t indexBytes, indexUsed;
+        size_t vertexLargestFree, indexLargestFree; // bytes, biggest mesh that's sure to fit
+        size_t holes;                               // free ranges in both buffers
+        unsigned long long moves, movedBytes;       // by defragment(), since creation
+    };
+    Stats stats() const;
+    void report(std::ostream &out) const;
+
+private:
+    unsigned int VBO, EBO;
+    GLsizei stride;
+    std::vector<VertexAttribute> layout;
+    GLenum indexType;
+    RangeAllocator vertexRanges, indexRanges;
+    ObjectPool<GeometryRange> ranges;
+    unsigned long long moves, movedBytes;
+
+    bool compact(RangeAllocator &allocator, unsigned int buffer, size_t unit, bool vertices, size_t &moved);
+
+    GeometryHeap(const GeometryHeap&) = delete;
+    GeometryHeap& operator=(const GeometryHeap&) = delete;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include "glstate.h"
+
+// Never a real object name or enum, marks shadow state as unknown.
+static const unsigned int UNKNOWN = 0xFFFFFFFFu;
+
+// Texture targets with their own binding per unit, the rest pass through.
+static const GLenum TEXTURE_TARGETS[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BUFFER };
+static const int TEXTURE_TARGET_COUNT = 4;
+
+static unsigned int program;
+static unsigned int vertexArray;
+static unsigned int arrayBuffer;
+static unsigned int elementBuffer;
+static unsigned int activeUnit;
+static unsigned int textures[GLState::MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+static unsigned int blend;
+static unsigned int blendSrc, blendDst;
+static unsigned int depthTest;
+static unsigned int depthWrite;
+static unsigned int depthCompare;
+static struct { unsigned int buffer; GLintptr offset; GLsizeiptr size; } uniformBindings[GLState::MAX_UNIFORM_BINDINGS];
+static int view[4];
+static bool viewKnown;
+
+GLState::Stats GLState::stats = { 0, 0 };
+
+// Count the call, return true when GL needs to hear about it.
+static bool differs(unsigned int &shadow, unsigned int value) {
+    GLState::stats.calls++;
+    if (shadow == value) {
+        GLState::stats.skipped++;
+        return false;
+    }
+    shadow = value;
+    return true;
+}
+
+void GLState::invalidate() {
+    program = vertexArray = arrayBuffer = elementBuffer = activeUnit = UNKNOWN;
+    for (int u = 0; u < MAX_TEXTURE_UNITS; u++)
+        for (int t = 0; t < TEXTURE_TARGET_COUNT; t++)
+            textures[u][t] = UNKNOWN;
+    blend = blendSrc = blendDst = UNKNOWN;
+    depthTest = depthWrite = depthCompare = UNKNOWN;
+    for (int i = 0; i < MAX_UNIFORM_BINDINGS; i++)
+        uniformBindings[i].buffer = UNKNOWN;
+    viewKnown = false;
+}
+
+void GLState::resetStats() {
+    stats.calls = 0;
+    stats.skipped = 0;
+}
+
+// Shadow starts unknown without anyone calling invalidate() first.
+static struct InitShadow { InitShadow() { GLState::invalidate(); } } initShadow;
+
+void GLState::useProgram(unsigned int id) {
+    if (differs(program, id))
+        glUseProgram(id);
+}
+
+void GLState::bindVertexArray(unsigned int vao) {
+    if (differs(vertexArray, vao)) {
+        glBindVertexArray(vao);
+        // The element buffer binding belongs to the VAO.
+        elementBuffer = UNKNOWN;
+    }
+}
+
+void GLState::bindBuffer(GLenum target, unsigned int buffer) {
+    if (target == GL_ARRAY_BUFFER) {
+        if (differs(arrayBuffer, buffer))
+            glBindBuffer(target, buffer);
+    } else if (target == GL_ELEMENT_ARRAY_BUFFER) {
+        if (differs(elementBuffer, buffer))
+            glBindBuffer(target, buffer);
+    } else {
+        stats.calls++;
+        glBindBuffer(target, buffer);
+    }
+}
+
+// size -1 stands for the whole buffer (glBindBufferBase).
+static bool uniformBindingDiffers(unsigned int index, unsigned int buffer, GLintptr offset, GLsizeiptr size) {
+    GLState::stats.calls++;
+    if (index >= (unsigned int)GLState::MAX_UNIFORM_BINDINGS)
+        return true;
+    if (uniformBindings[index].buffer == buffer && uniformBindings[index].offset == offset
+        && uniformBindings[index].size == size) {
+        GLState::stats.skipped++;
+        return false;
+    }
+    uniformBindings[index].buffer = buffer;
+    uniformBindings[index].offset = offset;
+    uniformBindings[index].size = size;
+    return true;
+}
+
+void GLState::bindBufferBase(GLenum target, unsigned int index, unsigned int buffer) {
+    if (target != GL_UNIFORM_BUFFER) {
+        stats.calls++;
+        glBindBufferBase(target, index, buffer);
+    } else if (uniformBindingDiffers(index, buffer, 0, -1)) {
+        glBindBufferBase(target, index, buffer);
+    }
+}
+
+void GLState::bindBufferRange(GLenum target, unsigned int index, unsigned int buffer, GLintptr offset, GLsizeiptr size) {
+    if (target != GL_UNIFORM_BUFFER) {
+        stats.calls++;
+        glBindBufferRange(target, index, buffer, offset, size);
+    } else if (uniformBindingDiffers(index, buffer, offset, size)) {
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+}
+
+void GLState::bindTexture(int unit, GLenum target, unsigned int texture) {
+    int t = 0;
+    while (t < TEXTURE_TARGET_COUNT && TEXTURE_TARGETS[t] != target)
+        t++;
+    if (unit < 0 || unit >= MAX_TEXTURE_UNITS || t == TEXTURE_TARGET_COUNT) {
+        stats.calls++;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (differs(textures[unit][t], texture)) {
+        if (activeUnit != (unsigned int)unit) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+        }
+        glBindTexture(target, texture);
+    }
+}
+
+void GLState::enableBlend(bool enabled) {
+    if (differs(blend, enabled)) {
+        if (enabled) glEnable(GL_BLEND);
+        else glDisable(GL_BLEND);
+    }
+}
+
+void GLState::blendFunc(GLenum src, GLenum dst) {
+    stats.calls++;
+    if (blendSrc == src && blendDst == dst) {
+        stats.skipped++;
+        return;
+    }
+    blendSrc = src;
+    blendDst = dst;
+    glBlendFunc(src, dst);
+}
+
+void GLState::enableDepthTest(bool enabled) {
+    if (differs(depthTest, enabled)) {
+        if (enabled) glEnable(GL_DEPTH_TEST);
+        else glDisable(GL_DEPTH_TEST);
+    }
+}
+
+void GLState::depthMask(bool write) {
+    if (differs(depthWrite, write))
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void GLState::depthFunc(GLenum func) {
+    if (differs(depthCompare, func))
+        glDepthFunc(func);
+}
+
+void GLState::viewport(int x, int y, int width, int height) {
+    stats.calls++;
+    if (viewKnown && view[0] == x && view[1] == y && view[2] == width && view[3] == height) {
+        stats.skipped++;
+        return;
+    }
+    view[0] = x; view[1] = y; view[2] = width; view[3] = height;
+    viewKnown = true;
+    glViewport(x, y, width, height);
+}
+
+void GLState::deleteProgram(unsigned int id) {
+    // GL keeps a deleted program current until something else is used,
+    // so it's not 0 yet. Unknown: the next useProgram() goes to GL.
+    if (program == id)
+        program = UNKNOWN;
+    glDeleteProgram(id);
+}
+
+void GLState::deleteVertexArrays(int n, const unsigned int *vaos) {
+    for (int i = 0; i < n; i++)
+        if (vertexArray == vaos[i]) {
+            vertexArray = 0;
+            elementBuffer = UNKNOWN;
+        }
+    glDeleteVertexArrays(n, vaos);
+}
+
+void GLState::deleteBuffers(int n, const unsigned int *buffers) {
+    for (int i = 0; i < n; i++) {
+        if (arrayBuffer == buffers[i])
+            arrayBuffer = 0;
+        if (elementBuffer == buffers[i])
+            elementBuffer = 0;
+        for (int b = 0; b < MAX_UNIFORM_BINDINGS; b++)
+            if (uniformBindings[b].buffer == buffers[i])
+                uniformBindings[b].buffer = 0;
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+void GLState::deleteTextures(int n, const unsigned int *ids) {
+    // Deleting unbinds it from every unit.
+    for (int i = 0; i < n; i++)
+        for (int u = 0; u < MAX_TEXTURE_UNITS; u++)
+            for (int t = 0; t < TEXTURE_TARGET_COUNT; t++)
+                if (textures[u][t] == ids[i])
+                    textures[u][t] = 0;
+    glDeleteTextures(n, ids);
+}
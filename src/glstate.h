@@ -0,0 +1,62 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <glad/glad.h>
+
+/*
+Shadow copy of the GL state the engine touches, so binding what's
+already bound costs nothing. Engine code calls these instead of the gl*
+functions they wrap.
+
+Everything starts out "unknown", the first call of each kind always goes
+to GL. If code outside the engine changes state behind our back, call
+invalidate(). Deleting through these wrappers keeps the shadow right
+when a bound object goes away (GL rebinds 0, and ids get reused).
+
+The element array binding is part of the VAO, so it's tracked per bound
+VAO: switching VAO forgets it.
+
+One GL context, one thread, same as the rest of the renderer.
+*/
+class GLState {
+public:
+    static const int MAX_TEXTURE_UNITS = 32;
+    static const int MAX_UNIFORM_BINDINGS = 16;
+
+    struct Stats {
+        unsigned long long calls;    // state calls made by the engine
+        unsigned long long skipped;  // of those, ones that didn't reach GL
+    };
+    static Stats stats;
+
+    // Forget everything, next call of each kind goes to GL.
+    static void invalidate();
+    static void resetStats();
+
+    static void useProgram(unsigned int program);
+    static void bindVertexArray(unsigned int vao);
+    // GL_ARRAY_BUFFER and GL_ELEMENT_ARRAY_BUFFER are cached, other
+    // targets go straight through.
+    static void bindBuffer(GLenum target, unsigned int buffer);
+    // Indexed GL_UNIFORM_BUFFER bindings are cached, buffer and range.
+    // Both also bind the generic target, which isn't tracked.
+    static void bindBufferBase(GLenum target, unsigned int index, unsigned int buffer);
+    static void bindBufferRange(GLenum target, unsigned int index, unsigned int buffer, GLintptr offset, GLsizeiptr size);
+    // Binds texture to unit (0 based). Only switches the active unit when
+    // the binding actually changes.
+    static void bindTexture(int unit, GLenum target, unsigned int texture);
+
+    static void enableBlend(bool enabled);
+    static void blendFunc(GLenum src, GLenum dst);
+    static void enableDepthTest(bool enabled);
+    static void depthMask(bool write);
+    static void depthFunc(GLenum func);
+    static void viewport(int x, int y, int width, int height);
+
+    static void deleteProgram(unsigned int program);
+    static void deleteVertexArrays(int n, const unsigned int *vaos);
+    static void deleteBuffers(int n, const unsigned int *buffers);
+    static void deleteTextures(int n, const unsigned int *textures);
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <EGL/egl.h>
+
+/*
+OpenGL 3.3 core context without a window, for perf boxes with no display
+and no GPU (Mesa's llvmpipe is fine).
+
+Uses EGL on the surfaceless platform (EGL_MESA_platform_surfaceless)
+when the driver has it, the default display otherwise, and makes the
+context current with no surface at all (EGL_KHR_surfaceless_context).
+Rendering goes into an FBO of the requested size, there is no swap and
+so no vsync.
+*/
+class HeadlessContext {
+public:
+    // Creates the context, loads GL through glad and binds the FBO.
+    // Check ok before using it.
+    HeadlessContext(int width, int height);
+    ~HeadlessContext();
+
+    // Stands in for glfwSwapBuffers, hands the frame to the driver.
+    void present();
+    // Move the context between threads: release() on the old one, then
+    // makeCurrent() on the new one.
+    bool makeCurrent();
+    void release();
+
+    bool ok;
+
+private:
+    EGLDisplay display;
+    EGLContext context;
+    unsigned int FBO, colorRBO;
+
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include "jobs.h"
+
+// Worker index + 1 on worker threads, 0 everywhere else (the shared queue).
+static thread_local unsigned int currentQueue = 0;
+static thread_local const JobSystem *currentSystem = NULL;
+
+JobSystem::JobSystem(unsigned int threads) {
+    if (threads == 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 1;
+    }
+    executed = 0;
+    stolen = 0;
+    queued = 0;
+    stopping = false;
+    for (unsigned int i = 0; i <= threads; i++)
+        queues.push_back(new Queue());
+    for (unsigned int i = 0; i < threads; i++)
+        this->threads.push_back(std::thread(&JobSystem::worker, this, i + 1));
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : threads)
+        t.join();
+    for (Queue *q : queues)
+        delete q;
+}
+
+void JobSystem::Queue::pushBack(const Job *jobs, size_t n) {
+    if (count + n > ring.size()) {
+        size_t size = ring.size();
+        while (count + n > size)
+            size *= 2;
+        std::vector<Job> grown(size);
+        for (size_t i = 0; i < count; i++)
+            grown[i] = ring[(head + i) & (ring.size() - 1)];
+        ring.swap(grown);
+        head = 0;
+    }
+    for (size_t i = 0; i < n; i++)
+        ring[(head + count + i) & (ring.size() - 1)] = jobs[i];
+    count += n;
+}
+
+void JobSystem::push(const Job *jobs, size_t count) {
+    unsigned int index = currentSystem == this ? currentQueue : 0;
+    Queue &q = *queues[index];
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.pushBack(jobs, count);
+    }
+    queued += (int)count;
+    // Taking the lock orders this against a worker about to sleep.
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    if (count == 1)
+        wake.notify_one();
+    else
+        wake.notify_all();
+}
+
+void JobSystem::run(const Job *jobs, size_t count, JobCounter *counter, JobCounter *after) {
+    if (count == 0)
+        return;
+    if (counter)
+        counter->value += (int)count;
+
+    if (after) {
+        std::lock_guard<std::mutex> lock(after->mutex);
+        if (after->value != 0) {
+            for (size_t i = 0; i < count; i++) {
+                after->parked.push_back(jobs[i]);
+                after->parked.back().counter = counter;
+            }
+            return;
+        }
+    }
+
+    // Small batches go through a stack copy, to set the counter.
+    const size_t CHUNK = 64;
+    Job copy[CHUNK];
+    for (size_t done = 0; done < count; ) {
+        size_t n = count - done < CHUNK ? count - done : CHUNK;
+        for (size_t i = 0; i < n; i++) {
+            copy[i] = jobs[done + i];
+            copy[i].counter = counter;
+        }
+        push(copy, n);
+        done += n;
+    }
+}
+
+// Own deque from the back, then everyone else's from the front,
+// starting at a different one each time.
+bool JobSystem::take(Job &job) {
+    if (queued <= 0)
+        return false;
+    unsigned int own = currentSystem == this ? currentQueue : 0;
+    {
+        Queue &q = *queues[own];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.count > 0) {
+            job = q.popBack();
+            queued--;
+            return true;
+        }
+    }
+
+    static thread_local unsigned int seed = 0x9e3779b9u ^ (unsigned int)(size_t)&seed;
+    seed = seed * 1664525u + 1013904223u;
+    unsigned int count = (unsigned int)queues.size();
+    unsigned int start = (seed >> 16) % count;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int index = (start + i) % count;
+        if (index == own)
+            continue;
+        Queue &q = *queues[index];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.count > 0) {
+            job = q.popFront();
+            queued--;
+            stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::finish(JobCounter *counter) {
+    if (!counter)
+        return;
+    // Not the last one: no lock needed, nobody can be done waiting yet.
+    int v = counter->value;
+    while (v > 1) {
+        if (counter->value.compare_exchange_weak(v, v - 1))
+            return;
+    }
+    // The last decrement happens under the lock and wait() takes it
+    // before returning, so the counter is still alive in here. Parked
+    // jobs are pushed after unlocking, from a per thread buffer they
+    // trade places with, so once warm nothing allocates.
+    static thread_local std::vector<Job> released;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (--counter->value != 0 || counter->parked.empty())
+            return;
+        released.clear();
+        released.swap(counter->parked);
+    }
+    // The counter may be gone from here on.
+    push(released.data(), released.size());
+    released.clear();
+}
+
+void JobSystem::execute(Job &job) {
+    job.fn(job.data, job.begin, job.end);
+    executed++;
+    finish(job.counter);
+}
+
+void JobSystem::wait(JobCounter &counter) {
+    int spins = 0;
+    while (!counter.done()) {
+        Job job;
+        if (take(job)) {
+            execute(job);
+            spins = 0;
+        } else if (++spins > 64) {
+            // The last jobs are running elsewhere.
+            std::this_thread::yield();
+        }
+    }
+    // The last finish() may still hold the lock, let it leave before
+    // the counter can go out of scope.
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void JobSystem::worker(unsigned int index) {
+    currentQueue = index;
+    currentSystem = this;
+    int spins = 0;
+    for (;;) {
+        Job job;
+        if (take(job)) {
+            execute(job);
+            spins = 0;
+            continue;
+        }
+        if (++spins < 64) {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping)
+            return;
+        spins = 0;
+    }
+}
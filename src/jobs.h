@@ -0,0 +1,158 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+// One piece of work: fn(data, begin, end). begin/end are a range for
+// parallelFor, plain jobs can ignore them.
+struct Job {
+    void (*fn)(void *data, size_t begin, size_t end);
+    void *data;
+    size_t begin, end;
+    JobCounter *counter; // set by run()
+};
+
+/*
+Counts unfinished jobs. run() adds to it, each job takes one off when it
+returns. JobSystem::wait() on it for a join, or pass it as the `after`
+of another run() to chain work without blocking anybody.
+*/
+class JobCounter {
+public:
+    JobCounter() : value(0) {}
+    bool done() const { return value == 0; }
+    int pending() const { return value; }
+
+private:
+    friend class JobSystem;
+    std::atomic<int> value;
+    std::mutex mutex;
+    std::vector<Job> parked; // waiting for value to reach 0
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+};
+
+/*
+Work stealing job scheduler, one per program.
+
+Every worker has its own deque. Jobs a worker spawns go to the back of
+its own deque and it takes from the back too, so nested work stays hot
+in its cache. A worker with nothing left steals from the front of a
+random other deque, where the oldest and usually biggest jobs sit.
+Jobs from threads that aren't workers (main, render) go into a shared
+deque that everyone steals from.
+
+Each deque has its own mutex, only held for a push or pop. Idle workers
+spin a little, then sleep until something is queued.
+
+wait() doesn't block idle: the waiting thread runs jobs until the
+counter hits zero, so waiting on the main thread adds a core instead of
+losing one, and jobs can wait on their own sub jobs without deadlock.
+*/
+class JobSystem {
+public:
+    // threads = 0 picks one less than the core count (the main thread
+    // helps out in wait()), at least 1.
+    explicit JobSystem(unsigned int threads = 0);
+    ~JobSystem();
+
+    // Queue jobs. counter (may be null) goes up by count now and down as
+    // they finish. If after is given and not done yet, the jobs are held
+    // back until it is.
+    void run(const Job *jobs, size_t count, JobCounter *counter, JobCounter *after = NULL);
+    void run(const Job &job, JobCounter *counter, JobCounter *after = NULL) { run(&job, 1, counter, after); }
+
+    // Runs jobs until counter is done.
+    void wait(JobCounter &counter);
+
+    // body(begin, end) over [0, count) in chunks of about grain,
+    // returns when all of them are done.
+    template <typename F>
+    void parallelFor(size_t count, size_t grain, const F &body);
+
+    unsigned int workerCount() const { return (unsigned int)threads.size(); }
+
+    // Jobs run and jobs taken from another thread's deque, since start.
+    std::atomic<long long> executed;
+    std::atomic<long long> stolen;
+
+private:
+    // A deque as a ring buffer that only ever grows, so once it has
+    // seen the busiest frame pushing and popping never allocates.
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Job> ring; // size is a power of two
+        size_t head;
+        size_t count;
+
+        Queue() : ring(256), head(0), count(0) {}
+        void pushBack(const Job *jobs, size_t n);
+        Job popBack() { count--; return ring[(head + count) & (ring.size() - 1)]; }
+        Job popFront() { Job job = ring[head]; head = (head + 1) & (ring.size() - 1); count--; return job; }
+    };
+
+    // queues[0] is the shared one, queues[i + 1] belongs to worker i
+    std::vector<Queue*> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int> queued;
+    std::atomic<bool> stopping;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    void push(const Job *jobs, size_t count);
+    bool take(Job &job);
+    void execute(Job &job);
+    void finish(JobCounter *counter);
+    void worker(unsigned int index);
+
+    template <typename F>
+    static void callRange(void *data, size_t begin, size_t end) { (*(const F*)data)(begin, end); }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+};
+
+template <typename F>
+void JobSystem::parallelFor(size_t count, size_t grain, const F &body) {
+    if (count == 0)
+        return;
+    if (grain == 0)
+        grain = 1;
+    // No point cutting finer than a few chunks per thread.
+    size_t minGrain = count / ((threads.size() + 1) * 4) + 1;
+    if (grain < minGrain)
+        grain = minGrain;
+    if (grain >= count) {
+        body((size_t)0, count);
+        return;
+    }
+
+    const size_t MAX_CHUNKS = 256;
+    Job chunks[MAX_CHUNKS];
+    size_t n = 0;
+    JobCounter counter;
+    for (size_t begin = 0; begin < count; begin += grain) {
+        size_t end = begin + grain < count ? begin + grain : count;
+        chunks[n].fn = &JobSystem::callRange<F>;
+        chunks[n].data = (void*)&body;
+        chunks[n].begin = begin;
+        chunks[n].end = end;
+        n++;
+        if (n == MAX_CHUNKS) {
+            run(chunks, n, &counter);
+            n = 0;
+        }
+    }
+    if (n > 0)
+        run(chunks, n, &counter);
+    wait(counter);
+}
+
+#endif
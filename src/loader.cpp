@@ -0,0 +1,140 @@
+#include "loader.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool AssetLoader::readFile(const std::string &path, std::string &out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    std::stringstream stream;
+    stream << file.rdbuf();
+    out = stream.str();
+    return true;
+}
+
+bool FileAsset::read() {
+    std::string bytes;
+    if (!AssetLoader::readFile(path, bytes)) {
+        std::cout << "ERROR::LOADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        return false;
+    }
+    data.assign(bytes.begin(), bytes.end());
+    return true;
+}
+
+bool ShaderAsset::read() {
+    return Shader::preprocess(vertexPath, vertexCode)
+        && Shader::preprocess(fragmentPath, fragmentCode);
+}
+
+bool ShaderAsset::create() {
+    return shader.build(vertexCode, fragmentCode);
+}
+
+AssetLoader::AssetLoader(unsigned int threads) {
+    if (threads == 0)
+        threads = 1;
+    inFlight = 0;
+    stopping = false;
+    for (unsigned int i = 0; i < threads; i++)
+        workers.push_back(std::thread(&AssetLoader::worker, this));
+}
+
+AssetLoader::~AssetLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : workers)
+        t.join();
+}
+
+FileHandle AssetLoader::loadFile(const std::string &path) {
+    FileHandle asset = std::make_shared<FileAsset>(path);
+    load(asset);
+    return asset;
+}
+
+ShaderHandle AssetLoader::loadShader(const std::string &vertexPath, const std::string &fragmentPath) {
+    ShaderHandle asset = std::make_shared<ShaderAsset>(vertexPath, fragmentPath);
+    load(asset);
+    return asset;
+}
+
+void AssetLoader::load(const std::shared_ptr<Asset> &asset) {
+    asset->state = Asset::QUEUED;
+    inFlight++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        readQueue.push_back(asset);
+    }
+    wake.notify_one();
+}
+
+void AssetLoader::worker() {
+    for (;;) {
+        std::shared_ptr<Asset> asset;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !readQueue.empty(); });
+            if (stopping)
+                return;
+            asset = readQueue.front();
+            readQueue.pop_front();
+        }
+
+        asset->state = Asset::READING;
+        bool ok = asset->read();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ok) {
+                asset->state = Asset::WAITING_GL;
+                glQueue.push_back(asset);
+            } else {
+                asset->state = Asset::FAILED;
+                inFlight--;
+            }
+        }
+        readDone.notify_all();
+    }
+}
+
+void AssetLoader::finish(const std::shared_ptr<Asset> &asset) {
+    asset->state = asset->create() ? Asset::READY : Asset::FAILED;
+    inFlight--;
+}
+
+void AssetLoader::update(double budgetMs) {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    for (;;) {
+        std::shared_ptr<Asset> asset;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (glQueue.empty())
+                return;
+            asset = glQueue.front();
+            glQueue.pop_front();
+        }
+        finish(asset);
+
+        std::chrono::duration<double, std::milli> spent = Clock::now() - start;
+        if (spent.count() >= budgetMs)
+            return;
+    }
+}
+
+void AssetLoader::wait(const std::shared_ptr<Asset> &asset) {
+    while (!asset->done()) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            readDone.wait(lock, [&] { return asset->state != Asset::QUEUED && asset->state != Asset::READING; });
+        }
+        // Everything ahead of it in the GL queue gets done too.
+        update(1.0e9);
+    }
+}
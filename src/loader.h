@@ -0,0 +1,119 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shader.h"
+
+/*
+One asset on its way in. Handles are shared_ptrs to these, check ready()
+or failed() each frame, like polling a future.
+
+Loading happens in two steps:
+  read()   on a worker thread: file I/O, parsing, preprocessing. No GL.
+  create() on the GL thread from AssetLoader::update(): make the GL
+           objects. Kept short, update() runs them under a time budget.
+           shared_from_this() works here, for queuing more GL work.
+*/
+class Asset : public std::enable_shared_from_this<Asset> {
+public:
+    enum State { QUEUED, READING, WAITING_GL, READY, FAILED };
+
+    Asset() : state(QUEUED) {}
+    virtual ~Asset() {}
+
+    bool ready() const { return state == READY; }
+    bool failed() const { return state == FAILED; }
+    bool done() const { return state == READY || state == FAILED; }
+
+    std::atomic<int> state;
+
+protected:
+    friend class AssetLoader;
+    virtual bool read() = 0;
+    virtual bool create() { return true; }
+};
+
+// Raw bytes of a file, for loaders that parse on their own.
+class FileAsset : public Asset {
+public:
+    explicit FileAsset(const std::string &path) : path(path) {}
+    std::string path;
+    std::vector<char> data;
+protected:
+    bool read();
+};
+
+// Vertex + fragment shader. Sources are read and their #include "file"
+// lines expanded on the worker, compile and link happen in create().
+class ShaderAsset : public Asset {
+public:
+    ShaderAsset(const std::string &vertexPath, const std::string &fragmentPath)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath) {}
+    std::string vertexPath, fragmentPath;
+    std::string vertexCode, fragmentCode;
+    Shader shader;
+protected:
+    bool read();
+    bool create();
+};
+
+typedef std::shared_ptr<FileAsset> FileHandle;
+typedef std::shared_ptr<ShaderAsset> ShaderHandle;
+
+/*
+Loads assets without blocking the render thread. Worker threads do the
+I/O, then the asset waits in a queue until update() (called once per
+frame on the GL thread) gives it its GL step. GL work per frame is
+limited to budgetMs, at least one asset always gets through so loading
+can't stall completely.
+*/
+class AssetLoader {
+public:
+    // At least 1. A couple is plenty, they mostly wait on the disk, and
+    // the cores belong to the JobSystem. Blocking reads don't go on its
+    // workers for the same reason, a job that sleeps holds up a frame.
+    explicit AssetLoader(unsigned int threads = 2);
+    ~AssetLoader();
+
+    FileHandle loadFile(const std::string &path);
+    ShaderHandle loadShader(const std::string &vertexPath, const std::string &fragmentPath);
+    // Queue an asset type defined elsewhere.
+    void load(const std::shared_ptr<Asset> &asset);
+
+    // GL thread, once per frame.
+    void update(double budgetMs);
+    // GL thread, blocks until the asset is done. For startup only.
+    void wait(const std::shared_ptr<Asset> &asset);
+
+    // Assets not ready or failed yet.
+    size_t pending() const { return inFlight; }
+
+    // Read a whole file, used by the assets. False if it can't be opened.
+    static bool readFile(const std::string &path, std::string &out);
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable readDone;
+    std::deque<std::shared_ptr<Asset> > readQueue;
+    std::deque<std::shared_ptr<Asset> > glQueue;
+    std::atomic<size_t> inFlight;
+    bool stopping;
+
+    void worker();
+    void finish(const std::shared_ptr<Asset> &asset);
+
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+};
+
+#endif
@@ -1,9 +1,32 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include "window.h"
 #include "shader.h"
+#include "batch.h"
+#include "benchmark.h"
+#include "profiler.h"
+#include "headless.h"
+#include "timestep.h"
+#include "loader.h"
+#include "watcher.h"
+#include "glstate.h"
+#include "renderqueue.h"
+#include "renderthread.h"
+#include "jobs.h"
+#include "ecs.h"
+#include "vecmath.h"
+#include "spatial.h"
+#include "texture.h"
+#include "memory.h"
+#include "uniforms.h"
+#include "uploadring.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
@@ -11,6 +34,88 @@ void processInput(GLFWwindow *window);
 // settings
 const unsigned int SCR_WIDTH = 1024;
 const unsigned int SCR_HEIGHT = 768;
+const double TICK_RATE = 60.0; // simulation ticks per second
+const double LOAD_BUDGET_MS = 2.0; // GL work for asset loading per frame
+const size_t UPLOAD_BUDGET = 256 * 1024; // texture bytes uploaded per frame
+const int HEAP_CHECK_WARMUP = 120; // frames before --heap-check starts counting
+
+// Framebuffer size as last reported by GLFW, main thread only. Goes to
+// the renderer in FrameData, the viewport is set where GL is current.
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
+
+// Everything the simulation owns. The renderer only reads it, blending
+// the last two ticks so motion stays smooth at any frame rate.
+// Entities live in the World and are only advanced, not blended, see
+// recordFrame().
+struct SimState {
+    double time;
+    float pulse;   // brightness, 0..1
+    float offsetX; // sideways sway of the tile grid
+    uint32_t seed; // particle randomness, same run every time
+};
+
+// Components, see ecs.h.
+struct Position { float x, y; };
+struct Velocity { float x, y; };
+struct Tint { float r, g, b, a; };
+struct Tile { float w, h; };           // grid tile, sways with offsetX
+struct Lifetime { float seconds; };    // particle is respawned at 0
+struct Bounds { AabbTree::Proxy proxy; }; // leaf in Scene::tree
+
+// Entities plus the spatial index used to cull them. Game thread only.
+struct Scene {
+    World world;
+    AabbTree tree;
+    std::vector<uint32_t> visible; // entities that passed culling, this frame
+    SpriteHandle tileSprite, dotSprite; // plain quads until both are usable()
+    FrameArena arena; // scratch for one frame, reset at the top of the loop
+
+    Scene() : tree(0.02f) {}
+};
+
+// What the game thread hands the renderer each frame. Plain data, no GL,
+// so it can be recorded on a different thread than the one drawing it.
+struct FrameData {
+    mat4 viewProjection;           // camera
+    float time, pulse;             // interpolated sim state the frame shows
+    float frameSeconds;            // since the last frame
+    int width, height;             // framebuffer
+    float simMs;                   // time spent simulating, for the profiler
+    unsigned int visible, culled;  // objects that passed / failed culling
+    unsigned int texture;          // sprite atlas, 0 draws untextured
+    std::vector<QuadVertex> quads; // tiles, 4 corners each
+};
+
+// Everything on the GL side. Only touched by the thread that has the
+// context current.
+struct Renderer {
+    GLFWwindow *window;
+    HeadlessContext *headless;
+    AssetLoader *loader;
+    TextureManager *textures;
+    ShaderWatcher *watcher;
+    ShaderHandle sceneShader;
+    bool sceneReady;
+    UniformStream *frameBlocks;    // Frame and Material blocks, see uniforms.h
+    QuadBatch *batch;
+    RenderQueue *queue;
+    FrameProfiler *profiler;
+    FrameProfiler::Region simRegion, clearRegion, bindRegion, drawRegion, swapRegion;
+    FrameProfiler::Counter visibleCounter, culledCounter;
+};
+
+void spawnScene(Scene &scene, SimState &state, int particles);
+void spawnParticle(Scene &scene, SimState &state);
+void simulate(SimState &state, Scene &scene, JobSystem &jobs, double dt);
+SimState interpolate(const SimState &previous, const SimState &current, float alpha);
+void recordFrame(FrameData &frame, const SimState &view, float lag, Scene &scene, JobSystem &jobs);
+void renderFrame(FrameData &frame, void *renderer);
+void attachContext(void *renderer);
+void detachContext(void *renderer);
+void flushBatch(void *batch);
+Image makeTileImage(int size);
+Image makeDotImage(int size);
 
 // Define a vertex shader. This is in the GLSL language and needs to
 // be compiled. It's defined as a string.
@@ -55,37 +160,100 @@ const char *fragmentShaderSource =
 //=============== MAIN IS HERE =================================
 //==============================================================
 
-int main()
+int main(int argc, char **argv)
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    #ifdef __APPLE__
-        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    #endif
+    // command line options
+    bool benchInstancing = false;
+    bool headless = false;
+    int headlessFrames = 1000;
+    const char *profileCsv = NULL;
+    unsigned int renderThreadFrames = 0; // 0 = render on the main thread
+    int particleCount = 0;
+    bool heapCheck = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bench-instancing")
+            benchInstancing = true;
+        else if (arg == "--headless")
+            headless = true;
+        else if (arg == "--frames" && i + 1 < argc)
+            headlessFrames = atoi(argv[++i]);
+        else if (arg == "--profile-csv" && i + 1 < argc)
+            profileCsv = argv[++i];
+        else if (arg == "--render-thread")
+            renderThreadFrames = 2;
+        else if (arg == "--frame-latency" && i + 1 < argc)
+            renderThreadFrames = atoi(argv[++i]);
+        else if (arg == "--entities" && i + 1 < argc)
+            particleCount = atoi(argv[++i]);
+        else if (arg == "--heap-check")
+            heapCheck = true;
+        else if (arg == "--heap-check-abort")
+            heapCheck = HeapCheck::abortOnViolation = true;
+        else if (arg == "--no-persistent")
+            UploadRing::allowPersistent = false;
+    }
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+    // Worker threads for per frame work, one per core besides this one.
+    // Started once and kept for the whole run, see jobs.h.
+    JobSystem *jobs = new JobSystem();
+
+    // Headless: no GLFW at all, EGL context rendering into an FBO.
+    // See headless.h.
+    GLFWwindow* window = NULL;
+    HeadlessContext *headlessContext = NULL;
+    if (headless) {
+        headlessContext = new HeadlessContext(SCR_WIDTH, SCR_HEIGHT);
+        if (!headlessContext->ok) {
+            delete headlessContext;
+            delete jobs;
+            return -1;
+        }
+    } else {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        #ifdef __APPLE__
+            glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        #endif
+
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            delete jobs;
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            delete jobs;
+            return -1;
+        }
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+    // Benchmark modes replace the normal scene.
+    if (benchInstancing) {
+        runInstancingBenchmark(window, headlessContext);
+        delete jobs;
+        if (headless)
+            delete headlessContext;
+        else
+            glfwTerminate();
+        return 0;
     }
 
     // ==========================================================
@@ -94,146 +262,517 @@ int main()
 
     // Moved to shader.h
 
-    //Shader myShader("src/shaders/shaders.vs", "src/shaders/shaders.fs");
-    Shader myShader("build/shaders/shaders.vs", "build/shaders/shaders.fs");
+    // Shaders load in the background, the window keeps running and the
+    // scene shows up once they're built. See loader.h.
+    AssetLoader *loader = new AssetLoader();
+    //ShaderHandle sceneShader = loader->loadShader("src/shaders/shaders.vs", "src/shaders/shaders.fs");
+    ShaderHandle sceneShader = loader->loadShader("build/shaders/shaders.vs", "build/shaders/shaders.fs");
+    // Benchmarks measure rendering, not loading.
+    if (headless)
+        loader->wait(sceneShader);
+
+    // Sprites are made on the CPU here, padded on a worker and packed
+    // into an atlas, uploaded a slice per frame. See texture.h.
+    TextureManager *textures = new TextureManager(*loader);
+    SpriteHandle tileSprite = textures->addSprite(makeTileImage(16));
+    SpriteHandle dotSprite = textures->addSprite(makeDotImage(16));
+    if (headless) {
+        loader->wait(tileSprite);
+        loader->wait(dotSprite);
+        textures->update(SIZE_MAX);
+    }
+
+    // Edit a shader (or run make, which copies src/shaders to
+    // build/shaders) and it's rebuilt without restarting.
+    ShaderWatcher *watcher = NULL;
+    if (!headless) {
+        watcher = new ShaderWatcher(*loader);
+        watcher->watch(sceneShader);
+    }
     // ==========================================================
     // ==============Buffers=====================================
     // ==========================================================
 
-    // ******** Single VBO *************
-    // Create Vertex Buffer Object, this is just an unsigned int
-    // for storing memory addresses.
-    unsigned int VBO; // address
-    // Create an array of buffer objects at address &VBO.
-    // Type is GLuint, an unsigned into with the address
-    // of a buffer object or VBO.
-    glGenBuffers(1, &VBO);
-    // Bind a hint to VBO so the program knows how to interpret
-    // the data.
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // ^ Any time I make a call on a GL_ARRAY_BUFFER,
-    // it's made to the currently bound buffer VBO
-
-    // ******** Define Vertex ***************
-    //Tell openGL how to handle the vertex data.
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    // Starting index, 0
-    // number of values in set, 3 for 3 dimensions
-    // type of data, GL_FLOAT
-    // normalize?, special boolean
-    // stride in bits, 3 x size of float to iterate through sets
-    // start at beginning
-    glEnableVertexAttribArray(0);
-    // Enable vertex attribute features, off by default.
-    // Arg is vertex attribute location.
-
-    // ******************************************************
-    // ******** VAO - Array of VBOs, easier access **********
-    // ******************************************************
-
-    // Vertex array object
-    /*
-    A vertex array object stores the following:
-    -Calls to glEnableVertexAttribArray or glDisableVertexAttribArray.
-    -Vertex attribute configurations via glVertexAttribPointer.
-    -Vertex buffer objects associated with vertex attributes by calls to glVertexAttribPointer.
-    */
-
-    float vertices2 [] {
-        0.5,0.5,0.0,
-        -0.5,0.5,0.0,
-        0.5,-0.5,0.0,
-        -0.5,-0.5,0.0,
-        -0.3,-0.8,0.1
-    };
-
-    unsigned int VAO; // address
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-    // copy our vertices array in a buffer for OpenGL to use
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices2), vertices2, GL_STATIC_DRAW);
-    // 4th arg tells the graphics card how to manage the data.
-    // Determines write speed based on storage location.
-    // GL_STREAM_DRAW: the data is set only once and used by the GPU at most a few times.
-    // GL_STATIC_DRAW: the data is set only once and used many times.
-    // GL_DYNAMIC_DRAW: the data is changed a lot and used many times.
+    // The batch owns its VAO, a streaming VBO and a static EBO.
+    // Quads are collected every frame and drawn in as few
+    // glDrawElements calls as possible, see batch.h.
+    QuadBatch *batch = new QuadBatch();
+
+    // Draws are submitted as packets, sorted by state and issued in one
+    // go each frame. See renderqueue.h.
+    RenderQueue *queue = new RenderQueue();
+
+    // Frame timing, printed on exit, see profiler.h.
+    FrameProfiler *profiler = new FrameProfiler();
+
+    Renderer renderer;
+    renderer.window = window;
+    renderer.headless = headlessContext;
+    renderer.loader = loader;
+    renderer.textures = textures;
+    renderer.watcher = watcher;
+    renderer.sceneShader = sceneShader;
+    renderer.sceneReady = false;
+    renderer.frameBlocks = new UniformStream(4096);
+    renderer.batch = batch;
+    renderer.queue = queue;
+    renderer.profiler = profiler;
+    renderer.simRegion = profiler->region("simulate");
+    renderer.clearRegion = profiler->region("clear");
+    renderer.bindRegion = profiler->region("shader bind");
+    renderer.drawRegion = profiler->region("draw");
+    renderer.swapRegion = profiler->region("swap");
+    renderer.visibleCounter = profiler->counter("visible");
+    renderer.culledCounter = profiler->counter("culled");
+
+    // --render-thread: GL calls move to their own thread and the game
+    // thread records frame N+1 while frame N is drawn. --frame-latency N
+    // sets how many frames may be in flight, 2 is the usual double
+    // buffering. See renderthread.h.
+    RenderThread<FrameData> *renderThread = NULL;
+    if (renderThreadFrames > 0) {
+        detachContext(&renderer);
+        renderThread = new RenderThread<FrameData>(renderThreadFrames, renderFrame, attachContext, detachContext, &renderer);
+    }
+    FrameData singleFrame;
 
+    // render loop
+    // -----------
+    int frameCount = 0;
+    FixedTimestep timestep(TICK_RATE);
+    SimState previousState = { 0.0, 0.5f, 0.0f, 12345u };
+    SimState currentState = previousState;
+    // The tile grid plus --entities N particles. See ecs.h, spatial.h.
+    Scene *scene = new Scene();
+    scene->tileSprite = tileSprite;
+    scene->dotSprite = dotSprite;
+    spawnScene(*scene, currentState, particleCount);
+    std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
+    double lastFrame = headless ? 0.0 : glfwGetTime();
+    while (headless ? frameCount < headlessFrames : !glfwWindowShouldClose(window))
+    {
+        // input
+        // -----
+        if (window)
+            processInput(window);
+        scene->arena.reset();
+
+        // simulation, fixed ticks
+        // -----------------------
+        // Headless runs use a fixed 60 Hz clock so every run draws the same frames.
+        double now = headless ? frameCount / 60.0 : glfwGetTime();
+        std::chrono::steady_clock::time_point simStart = std::chrono::steady_clock::now();
+        int ticks = timestep.advance(now);
+        for (int i = 0; i < ticks; i++) {
+            previousState = currentState;
+            simulate(currentState, *scene, *jobs, timestep.dt);
+        }
+        SimState view = interpolate(previousState, currentState, timestep.alpha());
+        std::chrono::duration<float, std::milli> simMs = std::chrono::steady_clock::now() - simStart;
+
+        // Blocks here when the renderer is frameLatency frames behind.
+        FrameData *frame = renderThread ? renderThread->acquire() : &singleFrame;
+        frame->simMs = simMs.count();
+        frame->frameSeconds = (float)(now - lastFrame);
+        lastFrame = now;
+        frame->width = framebufferWidth;
+        frame->height = framebufferHeight;
+        recordFrame(*frame, view, (float)((1.0 - timestep.alpha()) * timestep.dt), *scene, *jobs);
+        if (renderThread)
+            renderThread->submit(frame);
+        else
+            renderFrame(*frame, &renderer);
+
+        if (window)
+            glfwPollEvents();
+        frameCount++;
+        // Warmed up, every frame from here on should stay off the heap.
+        if (heapCheck && frameCount == HEAP_CHECK_WARMUP)
+            HeapCheck::forbid(true);
 
-    // ==========================================================
-    // ================= Element Buffer Objects  - EBO ==========
-    // ==========================================================
-    // Builds off of VAO
+        }
+        // -------------------------------------------------------------------------------
 
-    /*
-    What happening here is that we're selecting points from the lists
-    of vertices to build triangles.
-    */
+    HeapCheck::forbid(false);
 
-    unsigned int indices[] {
-        0,2,1, // Triangle 1
-        2,3,4  // Triangle 2
-    };
+    // Draws whatever is still queued, then gives the context back.
+    if (renderThread) {
+        std::cout << "Render thread: game waited on it " << renderThread->latencyWaits << " times" << std::endl;
+        delete renderThread;
+        attachContext(&renderer);
+    }
 
-    unsigned int EBO;
-    glGenBuffers(1, &EBO);
+    if (headless) {
+        // Wait for the GPU so the total covers all the work.
+        glFinish();
+        std::chrono::duration<double> total = std::chrono::steady_clock::now() - loopStart;
+        std::cout << "Rendered " << frameCount << " frames in " << total.count() << " s, "
+                  << frameCount / total.count() << " frames/s" << std::endl;
+    }
+    profiler->report(std::cout);
+    std::cout << "Textures: " << textures->bytesUploaded / 1024 << " KB uploaded" << std::endl;
+    for (size_t i = 0; i < textures->atlasCount(); i++)
+        std::cout << "Atlas " << i << ": " << textures->atlasOccupancy(i) * 100.0f << "% used" << std::endl;
+    std::cout << "GL state calls: " << GLState::stats.calls << ", skipped as redundant: "
+              << GLState::stats.skipped << std::endl;
+    // Every wait on the GPU the streaming buffers had to do, should be 0
+    // with the rings sized right.
+    const UploadRing::Stats *rings[] = { &batch->uploadStats(), &queue->uploadStats(),
+                                         &renderer.frameBlocks->uploadStats() };
+    unsigned long long stalls = 0, streamed = 0;
+    double waited = 0.0;
+    for (const UploadRing::Stats *ring : rings) {
+        stalls += ring->stalls;
+        waited += ring->stallMs;
+        streamed += ring->bytes;
+    }
+    std::cout << "Upload rings: " << stalls << " stalls, " << waited << " ms waited, "
+              << streamed / 1024 << " KB streamed" << std::endl;
+    if (profileCsv)
+        profiler->writeCsv(profileCsv);
+    std::cout << "Frame arena: " << scene->arena.highWater / 1024 << " KB high water, "
+              << scene->arena.overflows << " overflows" << std::endl;
+    int status = 0;
+    if (heapCheck) {
+        if (frameCount <= HEAP_CHECK_WARMUP) {
+            std::cout << "Heap check: not enough frames, needs more than " << HEAP_CHECK_WARMUP << std::endl;
+        } else if (HeapCheck::violations > 0) {
+            std::cout << "ERROR::MEMORY::HEAP_ALLOCATION_IN_FRAME " << HeapCheck::violations << " allocations in "
+                      << frameCount - HEAP_CHECK_WARMUP << " frames" << std::endl;
+            status = 1;
+        } else {
+            std::cout << "Heap check: no allocations in " << frameCount - HEAP_CHECK_WARMUP << " frames" << std::endl;
+        }
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    // GL objects have to go while the context still exists.
+    delete profiler;
+    delete renderer.frameBlocks;
+    delete queue;
+    delete batch;
+    delete watcher;
+    delete scene;
+    delete textures;
+    delete loader;
+    delete jobs;
 
-    // then set our vertex attributes pointers
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // ------------------------------------------------------------------
+    if (headless)
+        delete headlessContext;
+    else
+        glfwTerminate();
+    return status;
+}
 
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window))
-    {
-        // input
-        // -----
-        processInput(window);
+// create the tile grid and the particles
+// ---------------------------------------
+void spawnScene(Scene &scene, SimState &state, int particles)
+{
+    World &world = scene.world;
+    const int GRID_X = 64;
+    const int GRID_Y = 48;
+    const float tileW = 2.0f / GRID_X;
+    const float tileH = 2.0f / GRID_Y;
+    for (int y = 0; y < GRID_Y; y++) {
+        for (int x = 0; x < GRID_X; x++) {
+            Entity e = world.create();
+            world.add<Position>(e, { -1.0f + x * tileW, -1.0f + y * tileH });
+            // Leave a small gap between tiles.
+            world.add<Tile>(e, { tileW * 0.9f, tileH * 0.9f });
+            world.add<Tint>(e, { (float)x / GRID_X, (float)y / GRID_Y, 0.5f, 1.0f });
+            // Wide enough for the sway, they never move in the tree.
+            AABB box = { { -1.05f + x * tileW, -1.0f + y * tileH, 0.0f }, { -0.95f + (x + 0.9f) * tileW, -1.0f + (y + 0.9f) * tileH, 0.0f } };
+            world.add<Bounds>(e, { scene.tree.insert(box, e) });
+        }
+    }
+    for (int i = 0; i < particles; i++)
+        spawnParticle(scene, state);
+}
 
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+// 0..1 from a small LCG
+static float random01(uint32_t &seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+static AABB particleBox(const Position &p)
+{
+    AABB box = { { p.x, p.y, 0.0f }, { p.x + 0.006f, p.y + 0.008f, 0.0f } };
+    return box;
+}
 
-        // Copy data into the buffer memory. Doesn't need VBO
-        // reference because VBO is bound.
-        // glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-        // 4th arg tells the graphics card how to manage the data.
-        // Determines write speed based on storage location.
-        // GL_STREAM_DRAW: the data is set only once and used by the GPU at most a few times.
-        // GL_STATIC_DRAW: the data is set only once and used many times.
-        // GL_DYNAMIC_DRAW: the data is changed a lot and used many times.
+void spawnParticle(Scene &scene, SimState &state)
+{
+    World &world = scene.world;
+    Entity e = world.create();
+    if (e == NULL_ENTITY)
+        return;
+    world.add<Position>(e, { 0.0f, -0.9f });
+    world.add<Velocity>(e, { (random01(state.seed) - 0.5f) * 0.6f, 0.8f + random01(state.seed) * 0.8f });
+    world.add<Tint>(e, { 1.0f, 0.5f + random01(state.seed) * 0.5f, 0.1f, 1.0f });
+    world.add<Lifetime>(e, { 2.0f + random01(state.seed) * 4.0f });
+    world.add<Bounds>(e, { scene.tree.insert(particleBox(*world.get<Position>(e)), e) });
+}
 
+// advance the game by one fixed tick
+// ----------------------------------
+void simulate(SimState &state, Scene &scene, JobSystem &jobs, double dt)
+{
+    World &world = scene.world;
+    state.time += dt;
+    state.pulse = (sin(state.time) / 2.0f) + 0.5f;
+    state.offsetX = 0.05f * sin(state.time * 0.5);
+
+    // Particles fall under gravity, split over the workers.
+    const float step = (float)dt;
+    world.parallelEach<Velocity, Position, Lifetime>(jobs, 1024, [step](Entity, Velocity &v, Position &p, Lifetime &life) {
+        v.y -= 1.0f * step;
+        p.x += v.x * step;
+        p.y += v.y * step;
+        life.seconds -= step;
+    });
+    // Everything moves every tick, so no reinserting, just grow the
+    // boxes, stretched a few ticks ahead along the velocity. They're
+    // respawned (reinserted) every few seconds anyway.
+    world.each<Velocity, Position, Bounds>([&scene, step](Entity, Velocity &v, Position &p, Bounds &b) {
+        vec3 ahead = { v.x * step * 8.0f, v.y * step * 8.0f, 0.0f };
+        scene.tree.update(b.proxy, particleBox(p), ahead);
+    });
+
+    // Can't destroy while iterating, collect first.
+    FrameVector<Entity> expired((ArenaAllocator<Entity>(scene.arena)));
+    expired.reserve(64);
+    world.each<Lifetime>([&expired](Entity e, Lifetime &life) {
+        if (life.seconds <= 0.0f)
+            expired.push_back(e);
+    });
+    for (Entity e : expired) {
+        scene.tree.remove(world.get<Bounds>(e)->proxy);
+        world.destroy(e);
+        spawnParticle(scene, state);
+    }
+}
+
+// blend two ticks for drawing, alpha 0 is previous, 1 is current
+// ----------------------------------------------------------------
+SimState interpolate(const SimState &previous, const SimState &current, float alpha)
+{
+    SimState s;
+    s.time = previous.time + (current.time - previous.time) * alpha;
+    s.pulse = previous.pulse + (current.pulse - previous.pulse) * alpha;
+    s.offsetX = previous.offsetX + (current.offsetX - previous.offsetX) * alpha;
+    s.seed = current.seed;
+    return s;
+}
+
+// build the frame's draw data from the sim, no GL here
+// ------------------------------------------------------
+// Particles aren't kept for two ticks, lag (seconds the view is behind
+// the current tick) steps them back along their velocity instead.
+void recordFrame(FrameData &frame, const SimState &view, float lag, Scene &scene, JobSystem &jobs)
+{
+    ComponentPool<Tile> &tiles = scene.world.pool<Tile>();
+    ComponentPool<Velocity> &particles = scene.world.pool<Velocity>();
+    ComponentPool<Position> &positions = scene.world.pool<Position>();
+    ComponentPool<Tint> &tints = scene.world.pool<Tint>();
+
+    // 2D camera over the -1..1 square the scene is laid out in.
+    mat4 projection = mat4::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+    mat4 camera = mat4::lookAt({ 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f });
+    frame.viewProjection = projection * camera;
+    frame.time = (float)view.time;
+    frame.pulse = view.pulse;
+
+    // Only what the camera sees gets a quad. Tiles first so particles
+    // draw on top.
+    AabbTree::CullStats stats;
+    scene.visible.clear();
+    scene.tree.cull(Frustum::fromMatrix(frame.viewProjection), scene.visible, stats);
+    // Stable partition by hand, std::stable_partition takes its buffer
+    // from the heap.
+    FrameVector<uint32_t> others((ArenaAllocator<uint32_t>(scene.arena)));
+    others.reserve(scene.visible.size());
+    size_t tileCount = 0;
+    for (uint32_t e : scene.visible) {
+        if (tiles.has(World::index(e)))
+            scene.visible[tileCount++] = e;
+        else
+            others.push_back(e);
+    }
+    std::copy(others.begin(), others.end(), scene.visible.begin() + tileCount);
+    frame.visible = stats.visible;
+    frame.culled = stats.culled;
+
+    // Once usable() a sprite stays that way, safe to check from here.
+    static const float noUV[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+    bool textured = scene.tileSprite->usable() && scene.dotSprite->usable();
+    const float *tileUV = textured ? scene.tileSprite->uv : noUV;
+    const float *dotUV = textured ? scene.dotSprite->uv : noUV;
+    frame.texture = textured ? scene.tileSprite->texture : 0;
+
+    frame.quads.resize(scene.visible.size() * 4);
+    jobs.parallelFor(scene.visible.size(), 512, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t idx = World::index(scene.visible[i]);
+            const Position &p = positions.get(idx);
+            const Tint &t = tints.get(idx);
+            float color[4] = { t.r, t.g, t.b, t.a };
+            if (tiles.has(idx)) {
+                const Tile &tile = tiles.get(idx);
+                QuadBatch::makeQuad(&frame.quads[i * 4], p.x + view.offsetX, p.y, tile.w, tile.h, color, tileUV);
+            } else {
+                const Velocity &v = particles.get(idx);
+                QuadBatch::makeQuad(&frame.quads[i * 4], p.x - v.x * lag, p.y - v.y * lag, 0.006f, 0.008f, color, dotUV);
+            }
+        }
+    });
+}
 
-        // ****** Accessing uniform variables **************
-        float timeValue = glfwGetTime();
-        float greenValue = (sin(timeValue) / 2.0f) + 0.5f;
-        //int vertexColorLocation = glGetUniformLocation(myShader, "ourColor");
+// draw one recorded frame, runs wherever the GL context is current
+// -----------------------------------------------------------------
+void renderFrame(FrameData &frame, void *user)
+{
+    Renderer &r = *(Renderer*)user;
+    r.profiler->beginFrame();
+    r.profiler->record(r.simRegion, frame.simMs);
+    r.profiler->count(r.visibleCounter, (float)frame.visible);
+    r.profiler->count(r.culledCounter, (float)frame.culled);
+
+    // GL side of finished loads, a couple of ms per frame at most.
+    r.loader->update(LOAD_BUDGET_MS);
+    r.textures->update(UPLOAD_BUDGET);
+    if (r.watcher)
+        r.watcher->update();
+    if (!r.sceneReady && r.sceneShader->ready())
+        r.sceneReady = true;
+
+    // Follows window resizes, a no-op when the size didn't change.
+    GLState::viewport(0, 0, frame.width, frame.height);
+
+    r.profiler->begin(r.clearRegion);
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    r.profiler->end(r.clearRegion);
+
+    if (r.sceneReady) {
+        // ****** Uniform blocks, shared by every program **************
+        // Two small buffer updates per frame, whatever the number of
+        // programs and draws. See uniforms.h.
+        r.profiler->begin(r.bindRegion);
+        FrameUniforms f;
+        memcpy(f.viewProjection, frame.viewProjection.data(), sizeof(f.viewProjection));
+        f.time[0] = frame.time;
+        f.time[1] = frame.pulse;
+        f.time[2] = frame.frameSeconds;
+        f.time[3] = 0.0f;
+        f.viewport[0] = (float)frame.width;
+        f.viewport[1] = (float)frame.height;
+        f.viewport[2] = frame.width > 0 ? 1.0f / frame.width : 0.0f;
+        f.viewport[3] = frame.height > 0 ? 1.0f / frame.height : 0.0f;
+        // The pulse only dims the color, alpha stays.
+        MaterialUniforms m = { { frame.pulse, frame.pulse, frame.pulse, 1.0f }, { 0.5f, 0.0f, 0.0f, 0.0f } };
+        size_t frameOffset = 0, materialOffset = 0;
+        r.frameBlocks->reset();
+        r.frameBlocks->push(&f, sizeof(f), frameOffset);
+        r.frameBlocks->push(&m, sizeof(m), materialOffset);
+        r.frameBlocks->upload();
+        r.frameBlocks->bind(UBO_FRAME, frameOffset, sizeof(f));
+        r.profiler->end(r.bindRegion);
+
+        r.profiler->begin(r.drawRegion);
+        r.batch->begin();
+        r.batch->drawQuads(frame.quads.data(), frame.quads.size() / 4);
+        // The whole batch is one packet, it flushes when the queue
+        // gets to it.
+        DrawPacket tiles;
+        tiles.shader = &r.sceneShader->shader;
+        tiles.texture = frame.texture ? frame.texture : r.textures->whiteTexture();
+        tiles.material = r.frameBlocks->buffer();
+        tiles.materialOffset = r.frameBlocks->offset(materialOffset);
+        tiles.key = RenderQueue::makeKey(0, false, tiles.shader->ID, 0, tiles.texture, 0.5f);
+        tiles.custom = flushBatch;
+        tiles.user = r.batch;
+        r.queue->submit(tiles);
+
+        r.queue->execute();
+        r.frameBlocks->endFrame();
+        r.profiler->end(r.drawRegion);
+    }
 
-        myShader.use();
-        myShader.setFloat("ourColor", greenValue);
-        //glUniform4f(vertexColorLocation, 0.0f, greenValue, 0.0f, 1.0f);
+    // glfw: swap buffers (events are polled on the main thread)
+    r.profiler->begin(r.swapRegion);
+    if (r.headless)
+        r.headless->present();
+    else
+        glfwSwapBuffers(r.window);
+    r.profiler->end(r.swapRegion);
+    r.profiler->endFrame();
+}
 
+// make the GL context current on the calling thread / let go of it
+// -----------------------------------------------------------------
+void attachContext(void *user)
+{
+    Renderer &r = *(Renderer*)user;
+    if (r.headless)
+        r.headless->makeCurrent();
+    else
+        glfwMakeContextCurrent(r.window);
+}
 
-        glBindVertexArray(VAO);
-        //glDrawArrays(GL_TRIANGLES, 0, 3);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+void detachContext(void *user)
+{
+    Renderer &r = *(Renderer*)user;
+    if (r.headless)
+        r.headless->release();
+    else
+        glfwMakeContextCurrent(NULL);
+}
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+// render queue callback, draws everything collected in a QuadBatch
+// -----------------------------------------------------------------
+void flushBatch(void *batch)
+{
+    ((QuadBatch*)batch)->end();
+}
 
+// sprites for the scene, generated instead of loaded so there are no
+// image files to ship
+// -------------------------------------------------------------------
+// White with a darker bevel, the tint colors it.
+Image makeTileImage(int size)
+{
+    Image image(size, size);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            int edge = std::min(std::min(x, y), std::min(size - 1 - x, size - 1 - y));
+            unsigned char shade = edge == 0 ? 150 : edge == 1 ? 200 : 255;
+            unsigned char *p = image.pixel(x, y);
+            p[0] = p[1] = p[2] = shade;
+            p[3] = 255;
         }
-        // -------------------------------------------------------------------------------
-
+    }
+    return image;
+}
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
-    return 0;
+// Round dot, alpha falls off towards the rim.
+Image makeDotImage(int size)
+{
+    Image image(size, size);
+    float center = (size - 1) * 0.5f;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            float dx = (x - center) / (center + 0.5f);
+            float dy = (y - center) / (center + 0.5f);
+            float d = sqrtf(dx * dx + dy * dy);
+            unsigned char *p = image.pixel(x, y);
+            p[0] = p[1] = p[2] = 255;
+            p[3] = (unsigned char)(std::max(0.0f, std::min(1.0f, (1.0f - d) * 2.0f)) * 255.0f);
+        }
+    }
+    return image;
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -248,7 +787,9 @@ void processInput(GLFWwindow *window)
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-    // make sure the viewport matches the new window dimensions; note that width and
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    // no GL here, with --render-thread the context isn't current on this
+    // thread. renderFrame() sets the viewport from FrameData. Note that width
+    // and height will be significantly larger than specified on retina displays.
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
@@ -0,0 +1,316 @@
+#include "memory.h"
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+FrameArena::FrameArena(size_t capacity) {
+    this->size = capacity;
+    this->base = (char*)malloc(capacity);
+    // Fault the pages in now instead of in the middle of a frame.
+    memset(base, 0, capacity);
+    this->offset = 0;
+    this->highWater = 0;
+    this->overflows = 0;
+    this->overflowBytes = 0;
+}
+
+FrameArena::~FrameArena() {
+    for (void *block : overflow)
+        free(block);
+    free(base);
+}
+
+void *FrameArena::allocate(size_t size, size_t align) {
+    if (size == 0)
+        size = 1;
+    // Claim size + align - 1 and align inside it, so the claim is a
+    // single add even with other threads allocating.
+    size_t claim = size + align - 1;
+    size_t start = offset.fetch_add(claim, std::memory_order_relaxed);
+    if (start + claim <= this->size) {
+        uintptr_t p = (uintptr_t)(base + start);
+        p = (p + align - 1) & ~(uintptr_t)(align - 1);
+        return (void*)p;
+    }
+
+    // Out of room this frame. Its own heap block, freed at reset().
+    std::lock_guard<std::mutex> lock(overflowMutex);
+    void *block = NULL;
+    if (posix_memalign(&block, align < sizeof(void*) ? sizeof(void*) : align, size) != 0)
+        throw std::bad_alloc();
+    overflow.push_back(block);
+    overflowBytes += size;
+    return block;
+}
+
+void FrameArena::reset() {
+    size_t frameUsed = offset;
+    if (frameUsed > size)
+        frameUsed = size;
+    frameUsed += overflowBytes;
+    if (frameUsed > highWater)
+        highWater = frameUsed;
+
+    if (!overflow.empty()) {
+        for (void *block : overflow)
+            free(block);
+        overflow.clear();
+        overflowBytes = 0;
+        overflows++;
+        // Big enough for that frame with room to spare.
+        size_t grown = highWater + highWater / 2;
+        std::cout << "FrameArena: grew from " << size << " to " << grown << " bytes" << std::endl;
+        free(base);
+        base = (char*)malloc(grown);
+        memset(base, 0, grown);
+        size = grown;
+    }
+    offset = 0;
+}
+
+static inline int log2floor(size_t x) {
+    return 63 - __builtin_clzll((unsigned long long)x);
+}
+
+RangeAllocator::RangeAllocator(size_t capacity) {
+    this->total = capacity;
+    this->usedSize = 0;
+    this->freeCount = 0;
+    this->first = NULL;
+    this->last = NULL;
+    this->flBitmap = 0;
+    memset(slBitmap, 0, sizeof(slBitmap));
+    memset(lists, 0, sizeof(lists));
+    if (capacity > 0) {
+        Block *all = blocks.create();
+        all->offset = 0;
+        all->size = capacity;
+        all->user = NULL;
+        all->prev = all->next = NULL;
+        insertFree(all);
+        // The block at offset 0 only ever grows or splits, it's always the
+        // first.
+        first = last = all;
+    }
+}
+
+// Size class: below SL_COUNT one list per size, above that fl is the
+// power of two and sl the next SL_BITS bits under it.
+void RangeAllocator::mapping(size_t size, int &fl, int &sl) {
+    if (size < (size_t)SL_COUNT) {
+        fl = 0;
+        sl = (int)size;
+        return;
+    }
+    int f = log2floor(size);
+    fl = f - SL_BITS + 1;
+    sl = (int)(size >> (f - SL_BITS)) - SL_COUNT;
+}
+
+void RangeAllocator::insertFree(Block *block) {
+    int fl, sl;
+    mapping(block->size, fl, sl);
+    block->free = true;
+    block->prevFree = NULL;
+    block->nextFree = lists[fl][sl];
+    if (block->nextFree)
+        block->nextFree->prevFree = block;
+    lists[fl][sl] = block;
+    flBitmap |= (uint64_t)1 << fl;
+    slBitmap[fl] |= 1u << sl;
+    freeCount++;
+}
+
+void RangeAllocator::removeFree(Block *block) {
+    int fl, sl;
+    mapping(block->size, fl, sl);
+    if (block->prevFree)
+        block->prevFree->nextFree = block->nextFree;
+    else
+        lists[fl][sl] = block->nextFree;
+    if (block->nextFree)
+        block->nextFree->prevFree = block->prevFree;
+    if (!lists[fl][sl]) {
+        slBitmap[fl] &= ~(1u << sl);
+        if (!slBitmap[fl])
+            flBitmap &= ~((uint64_t)1 << fl);
+    }
+    block->free = false;
+    freeCount--;
+}
+
+RangeAllocator::Block *RangeAllocator::findFree(size_t size) {
+    // Round up to the next class, every block in it is big enough.
+    if (size >= (size_t)SL_COUNT) {
+        size_t round = ((size_t)1 << (log2floor(size) - SL_BITS)) - 1;
+        if (size > total || size + round < size)
+            return NULL;
+        size += round;
+    }
+    int fl, sl;
+    mapping(size, fl, sl);
+    if (fl >= FL_COUNT)
+        return NULL;
+    uint32_t slMap = slBitmap[fl] & (~0u << sl);
+    if (!slMap) {
+        uint64_t flMap = flBitmap & (~(uint64_t)0 << (fl + 1));
+        if (!flMap)
+            return NULL;
+        fl = __builtin_ctzll(flMap);
+        slMap = slBitmap[fl];
+    }
+    return lists[fl][__builtin_ctz(slMap)];
+}
+
+RangeAllocator::Block *RangeAllocator::allocate(size_t size) {
+    if (size == 0)
+        size = 1;
+    Block *block = findFree(size);
+    return block ? take(block, size) : NULL;
+}
+
+RangeAllocator::Block *RangeAllocator::allocateLowest(size_t size, size_t limit) {
+    if (size == 0)
+        size = 1;
+    for (Block *b = first; b && b->offset < limit; b = b->next) {
+        if (b->free && b->size >= size)
+            return take(b, size);
+    }
+    return NULL;
+}
+
+// Marks the start of a free block used, the rest goes back as a free
+// block of its own.
+RangeAllocator::Block *RangeAllocator::take(Block *block, size_t size) {
+    removeFree(block);
+    if (block->size > size) {
+        Block *rest = blocks.create();
+        rest->offset = block->offset + size;
+        rest->size = block->size - size;
+        rest->user = NULL;
+        rest->prev = block;
+        rest->next = block->next;
+        if (rest->next)
+            rest->next->prev = rest;
+        else
+            last = rest;
+        block->next = rest;
+        block->size = size;
+        insertFree(rest);
+    }
+    block->user = NULL;
+    usedSize += block->size;
+    return block;
+}
+
+void RangeAllocator::free(Block *block) {
+    if (!block || block->free)
+        return;
+    usedSize -= block->size;
+
+    Block *next = block->next;
+    if (next && next->free) {
+        removeFree(next);
+        block->size += next->size;
+        block->next = next->next;
+        if (block->next)
+            block->next->prev = block;
+        else
+            last = block;
+        blocks.destroy(next);
+    }
+    Block *prev = block->prev;
+    if (prev && prev->free) {
+        removeFree(prev);
+        prev->size += block->size;
+        prev->next = block->next;
+        if (prev->next)
+            prev->next->prev = prev;
+        else
+            last = prev;
+        blocks.destroy(block);
+        block = prev;
+    }
+    insertFree(block);
+}
+
+RangeAllocator::Block *RangeAllocator::highest() const {
+    // Free neighbours are always merged, so this is one step at most.
+    for (Block *b = last; b; b = b->prev) {
+        if (!b->free)
+            return b;
+    }
+    return NULL;
+}
+
+size_t RangeAllocator::largestFree() const {
+    if (!flBitmap)
+        return 0;
+    // The biggest blocks are all in the highest non empty list.
+    int fl = 63 - __builtin_clzll(flBitmap);
+    int sl = 31 - __builtin_clz(slBitmap[fl]);
+    size_t largest = 0;
+    for (Block *b = lists[fl][sl]; b; b = b->nextFree)
+        largest = b->size > largest ? b->size : largest;
+    return largest;
+}
+
+std::atomic<unsigned long long> HeapCheck::count(0);
+std::atomic<unsigned long long> HeapCheck::violations(0);
+std::atomic<bool> HeapCheck::forbidden(false);
+std::atomic<bool> HeapCheck::abortOnViolation(false);
+
+void HeapCheck::record() {
+    count.fetch_add(1, std::memory_order_relaxed);
+    if (forbidden.load(std::memory_order_relaxed)) {
+        violations.fetch_add(1, std::memory_order_relaxed);
+        if (abortOnViolation)
+            abort(); // the stack shows who allocated
+    }
+}
+
+// Global operator new/delete, replaced to feed HeapCheck. Same behavior
+// as the defaults otherwise.
+void *operator new(size_t size) {
+    HeapCheck::record();
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept {
+    HeapCheck::record();
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+    HeapCheck::record();
+    void *p = NULL;
+    size_t a = (size_t)align < sizeof(void*) ? sizeof(void*) : (size_t)align;
+    if (posix_memalign(&p, a, size ? size : 1) != 0)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { free(p); }
@@ -0,0 +1,235 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+Bump allocator for memory that only lives for one frame.
+
+allocate() is one atomic add, safe from any thread (jobs can use it
+too). Nothing is freed on its own, reset() at the start of the frame
+takes everything back at once. Whoever owns the arena decides when
+that is, everything allocated from it has to be dead by then.
+
+The block is touched page by page up front, so the first frames don't
+take page faults either. A frame that runs out gets extra blocks from
+the heap (counted in overflows), reset() then frees them and grows the
+main block to the high water mark, so it only happens once.
+*/
+class FrameArena {
+public:
+    explicit FrameArena(size_t capacity = 1 << 20);
+    ~FrameArena();
+
+    void *allocate(size_t size, size_t align = alignof(max_align_t));
+    template <typename T>
+    T *allocateArray(size_t count) { return (T*)allocate(count * sizeof(T), alignof(T)); }
+
+    void reset();
+
+    size_t used() const { return offset; }
+    size_t capacity() const { return size; }
+    size_t highWater;        // most used in one frame, overflow included
+    unsigned int overflows;  // frames that needed extra blocks
+
+private:
+    char *base;
+    size_t size;
+    std::atomic<size_t> offset;
+    std::mutex overflowMutex;
+    std::vector<void*> overflow;
+    size_t overflowBytes;
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+};
+
+// std allocator on top of a FrameArena. deallocate() does nothing, a
+// growing container leaves its old buffers behind until reset(), so
+// reserve() when the size is known.
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    FrameArena *arena;
+
+    explicit ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return arena->allocateArray<T>(n); }
+    void deallocate(T*, size_t) {}
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena != b.arena; }
+
+// A vector that lives until the arena's next reset().
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T> >;
+
+/*
+Fixed size objects, for things that come and go all the time. Blocks of
+perBlock objects are allocated as needed and kept until the pool dies,
+freed objects go on a free list threaded through their own memory, so
+once the pool has grown to its working size create() and destroy() are
+a couple of pointer moves. Not thread safe, one owner.
+*/
+template <typename T>
+class ObjectPool {
+public:
+    explicit ObjectPool(size_t perBlock = 256) : perBlock(perBlock ? perBlock : 1), freeList(NULL), live(0) {}
+    ~ObjectPool() {
+        // Objects still alive are not destructed, that's the owner's bug.
+        for (Slot *block : blocks)
+            ::operator delete(block);
+    }
+
+    template <typename... Args>
+    T *create(Args&&... args) {
+        if (!freeList)
+            grow();
+        Slot *slot = freeList;
+        freeList = slot->next;
+        live++;
+        return new (slot->storage) T(static_cast<Args&&>(args)...);
+    }
+
+    void destroy(T *object) {
+        if (!object)
+            return;
+        object->~T();
+        Slot *slot = (Slot*)object;
+        slot->next = freeList;
+        freeList = slot;
+        live--;
+    }
+
+    size_t liveCount() const { return live; }
+    size_t capacity() const { return blocks.size() * perBlock; }
+
+private:
+    union Slot {
+        Slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    size_t perBlock;
+    std::vector<Slot*> blocks;
+    Slot *freeList;
+    size_t live;
+
+    void grow() {
+        Slot *block = (Slot*)::operator new(perBlock * sizeof(Slot));
+        blocks.push_back(block);
+        for (size_t i = perBlock; i-- > 0; ) {
+            block[i].next = freeList;
+            freeList = &block[i];
+        }
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+};
+
+/*
+Hands out ranges of something that isn't CPU memory, e.g. a GPU buffer,
+in whatever unit the owner likes (bytes, vertices, indices). Only the
+bookkeeping lives here, nothing is ever read or written at the offsets.
+
+Two level segregated fit (TLSF): free ranges sit in lists by size class,
+a power of two split 16 ways, and two bitmaps say which lists have
+anything. allocate() and free() are a few bit scans and list moves, no
+searching, and free() merges with free neighbours right away. A request
+is rounded up to its class before looking, so any range found fits, at
+the cost of sometimes not seeing an exact fit in the class below.
+
+Blocks come from an ObjectPool and stay valid until freed, owners keep
+them as handles. user is theirs.
+*/
+class RangeAllocator {
+public:
+    struct Block {
+        size_t offset, size;
+        void *user;
+        // Neighbours in the range, and in the free list while free.
+        Block *prev, *next;
+        Block *prevFree, *nextFree;
+        bool free;
+    };
+
+    explicit RangeAllocator(size_t capacity);
+
+    // NULL when no free range is big enough.
+    Block *allocate(size_t size);
+    // The free range closest to the start that fits, if it begins below
+    // limit, else NULL. Walks the ranges, for compacting, not for every
+    // allocation.
+    Block *allocateLowest(size_t size, size_t limit);
+    void free(Block *block);
+
+    // The used block furthest from the start, NULL when empty.
+    Block *highest() const;
+
+    size_t capacity() const { return total; }
+    size_t used() const { return usedSize; }
+    size_t allocations() const { return blocks.liveCount() - freeCount; }
+    size_t freeRanges() const { return freeCount; }
+    size_t largestFree() const;
+
+private:
+    static const int SL_BITS = 4;
+    static const int SL_COUNT = 1 << SL_BITS;
+    static const int FL_COUNT = sizeof(size_t) * 8 - SL_BITS + 1;
+
+    size_t total, usedSize, freeCount;
+    ObjectPool<Block> blocks;
+    Block *first, *last;            // start and end of the range
+    uint64_t flBitmap;
+    uint32_t slBitmap[FL_COUNT];
+    Block *lists[FL_COUNT][SL_COUNT];
+
+    static void mapping(size_t size, int &fl, int &sl);
+    void insertFree(Block *block);
+    void removeFree(Block *block);
+    Block *findFree(size_t size);
+    Block *take(Block *block, size_t size);
+
+    RangeAllocator(const RangeAllocator&) = delete;
+    RangeAllocator& operator=(const RangeAllocator&) = delete;
+};
+
+/*
+Counts every operator new in the program (memory.cpp replaces the
+global ones), to catch steady state frames that go to the heap.
+
+  HeapCheck::forbid(true) once warmed up, then check violations, or
+  set abortOnViolation to stop in the debugger right at the culprit.
+
+Only C++ allocations are seen, malloc from C code and drivers is not.
+*/
+class HeapCheck {
+public:
+    static unsigned long long allocations() { return count; }
+    static void forbid(bool on) { forbidden = on; }
+    static bool forbidding() { return forbidden; }
+
+    // Allocations made while forbidden.
+    static std::atomic<unsigned long long> violations;
+    static std::atomic<bool> abortOnViolation;
+
+    // Called by the operator new replacements.
+    static void record();
+
+private:
+    static std::atomic<unsigned long long> count;
+    static std::atomic<bool> forbidden;
+};
+
+#endif
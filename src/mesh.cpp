@@ -0,0 +1,220 @@
+#include "mesh.h"
+#include "geometryheap.h"
+#include "glstate.h"
+
+#include <iostream>
+#include <vector>
+
+// A mat4 attribute takes four locations, one vec4 per column.
+const VertexAttribute Mesh::INSTANCE_ATTRIBUTES[6] = {
+    { 3, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, model) },
+    { 4, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, model) + 4 * sizeof(float) },
+    { 5, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, model) + 8 * sizeof(float) },
+    { 6, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, model) + 12 * sizeof(float) },
+    { 7, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, color) },
+    { 8, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData, uvRect) },
+};
+
+const VertexAttribute Mesh::FILE_LAYOUT[3] = {
+    { 0, 3, GL_FLOAT, GL_FALSE, offsetof(MeshFileVertex, position) },
+    { 1, 3, GL_FLOAT, GL_FALSE, offsetof(MeshFileVertex, normal) },
+    { 2, 2, GL_FLOAT, GL_FALSE, offsetof(MeshFileVertex, uv) },
+};
+
+const VertexAttribute Mesh::PACKED_LAYOUT[3] = {
+    { 0, 3, GL_HALF_FLOAT, GL_FALSE, offsetof(MeshPackedVertex, position) },
+    { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(MeshPackedVertex, normal) },
+    { 2, 2, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(MeshPackedVertex, uv) },
+};
+
+Mesh::Mesh(const float *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount) {
+    VertexAttribute position = { 0, 3, GL_FLOAT, GL_FALSE, 0 };
+    // Half the index bandwidth when 16 bits are enough.
+    if (vertexCount <= 65536) {
+        std::vector<unsigned short> narrow(indices, indices + indexCount);
+        init(vertices, vertexCount, 3 * sizeof(float), &position, 1, narrow.data(), indexCount, GL_UNSIGNED_SHORT);
+    } else {
+        init(vertices, vertexCount, 3 * sizeof(float), &position, 1, indices, indexCount, GL_UNSIGNED_INT);
+    }
+    decodeBlock.update(decode);
+}
+
+Mesh::Mesh(const void *vertices, size_t vertexCount, GLsizei stride, const VertexAttribute *attributes,
+           size_t attributeCount, const void *indices, size_t indexCount, GLenum indexType) {
+    init(vertices, vertexCount, stride, attributes, attributeCount, indices, indexCount, indexType);
+    decodeBlock.update(decode);
+}
+
+Mesh::Mesh(const MeshFile &file, uint32_t lod, GeometryHeap *heap) {
+    const MeshFileHeader &h = file.header();
+    const MeshFileLod &l = file.lod(lod);
+    bool packed = h.vertexFormat == MESH_VERTEX_PACKED;
+    init(file.vertices(lod), l.vertexCount, h.vertexStride, packed ? PACKED_LAYOUT : FILE_LAYOUT, 3,
+         file.indices(lod), l.indexCount, l.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, heap);
+
+    if (packed) {
+        // Same center and extent the writer packed with.
+        for (int k = 0; k < 3; k++) {
+            decode.positionOffset[k] = (h.boundsMin[k] + h.boundsMax[k]) * 0.5f;
+            decode.positionScale[k] = (h.boundsMax[k] - h.boundsMin[k]) * 0.5f;
+        }
+        for (int k = 0; k < 2; k++) {
+            decode.uvTransform[k] = h.uvMin[k];
+            decode.uvTransform[2 + k] = h.uvMax[k] - h.uvMin[k];
+        }
+        decode.positionScale[3] = 1.0f; // octahedral normals
+    }
+    // Written once, it never changes after loading.
+    decodeBlock.update(decode);
+}
+
+void Mesh::init(const void *vertices, size_t vertexCount, GLsizei stride, const VertexAttribute *attributes,
+                size_t attributeCount, const void *indices, size_t indexCount, GLenum indexType,
+                GeometryHeap *heap) {
+    this->indexCount = (GLsizei)indexCount;
+    this->indexType = indexType;
+    this->instanceVBO = 0;
+    this->maxInstances = 0;
+    this->VBO = 0;
+    this->EBO = 0;
+    this->heap = NULL;
+    this->range = NULL;
+    for (int k = 0; k < 4; k++) {
+        decode.positionScale[k] = k < 3 ? 1.0f : 0.0f;
+        decode.positionOffset[k] = 0.0f;
+    }
+    decode.uvTransform[0] = decode.uvTransform[1] = 0.0f;
+    decode.uvTransform[2] = decode.uvTransform[3] = 1.0f;
+
+    if (heap) {
+        if (!heap->accepts(stride, attributes, attributeCount, indexType))
+            std::cout << "ERROR::MESH::HEAP_LAYOUT_MISMATCH" << std::endl;
+        else
+            range = heap->add(vertices, vertexCount, indices, indexCount);
+        // Full or the wrong layout, buffers of its own it is.
+        if (range) {
+            this->heap = heap;
+            VAO = heap->VAO;
+            return;
+        }
+    }
+
+    glGenVertexArrays(1, &VAO);
+    GLState::bindVertexArray(VAO);
+
+    glGenBuffers(1, &VBO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * stride, vertices, GL_STATIC_DRAW);
+
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    glGenBuffers(1, &EBO);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indices, GL_STATIC_DRAW);
+
+    for (size_t i = 0; i < attributeCount; i++) {
+        const VertexAttribute &a = attributes[i];
+        glVertexAttribPointer(a.location, a.size, a.type, a.normalized, stride, (void*)a.offset);
+        glEnableVertexAttribArray(a.location);
+    }
+
+    GLState::bindVertexArray(0);
+}
+
+Mesh::~Mesh() {
+    if (range) {
+        heap->remove(range);
+        return;
+    }
+    GLState::deleteVertexArrays(1, &VAO);
+    GLState::deleteBuffers(1, &VBO);
+    GLState::deleteBuffers(1, &EBO);
+    if (instanceVBO)
+        GLState::deleteBuffers(1, &instanceVBO);
+}
+
+void Mesh::bindDecode() const {
+    decodeBlock.bind(UBO_MESH);
+}
+
+GLuint Mesh::firstIndex() const {
+    return range ? range->firstIndex() : 0;
+}
+
+GLint Mesh::baseVertex() const {
+    return range ? range->baseVertex() : 0;
+}
+
+void Mesh::draw() const {
+    bindDecode();
+    GLState::bindVertexArray(VAO);
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)(firstIndex() * indexSize), baseVertex());
+}
+
+void Mesh::enableInstancing(size_t maxInstances) {
+    if (range) {
+        std::cout << "ERROR::MESH::INSTANCING_IN_GEOMETRY_HEAP" << std::endl;
+        return;
+    }
+    this->maxInstances = maxInstances;
+
+    GLState::bindVertexArray(VAO);
+    if (!instanceVBO)
+        glGenBuffers(1, &instanceVBO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, maxInstances * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+
+    for (const VertexAttribute &a : INSTANCE_ATTRIBUTES) {
+        glVertexAttribPointer(a.location, a.size, a.type, a.normalized, sizeof(InstanceData), (void*)a.offset);
+        glEnableVertexAttribArray(a.location);
+        glVertexAttribDivisor(a.location, 1);
+    }
+
+    GLState::bindVertexArray(0);
+}
+
+size_t Mesh::uploadInstances(const InstanceData *instances, size_t count) {
+    if (count > maxInstances)
+        count = maxInstances;
+    if (count == 0)
+        return 0;
+
+    // Orphan and refill, the GPU can keep reading last frame's copy.
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, maxInstances * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances);
+    return count;
+}
+
+void Mesh::drawInstanced(const InstanceData *instances, size_t count) {
+    count = uploadInstances(instances, count);
+    if (count == 0)
+        return;
+
+    bindDecode();
+    GLState::bindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, 0, (GLsizei)count);
+}
+
+bool MeshAsset::read() {
+    if (!file.open(path))
+        return false;
+    if (lod >= file.lodCount()) {
+        std::cout << "ERROR::MESH::NO_SUCH_LOD " << path << ": " << lod << std::endl;
+        file.close();
+        return false;
+    }
+    // Reading the blobs here also faults their pages in, create() then
+    // copies from memory instead of waiting on the disk.
+    if (!file.verify(lod)) {
+        file.close();
+        return false;
+    }
+    return true;
+}
+
+bool MeshAsset::create() {
+    mesh = new Mesh(file, lod, heap);
+    file.close();
+    return true;
+}
@@ -0,0 +1,143 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "loader.h"
+#include "meshfile.h"
+#include "uniforms.h"
+
+class GeometryHeap;
+struct GeometryRange;
+
+// Per-instance data, one entry per copy of the mesh.
+// Attribute locations: 3-6 = model matrix columns, 7 = color, 8 = UV rect.
+struct InstanceData {
+    float model[16];  // column major
+    float color[4];
+    float uvRect[4];  // u, v offset then width, height in the texture
+};
+
+// One attribute inside an interleaved vertex, for glVertexAttribPointer.
+struct VertexAttribute {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    size_t offset;
+};
+
+/*
+Indexed triangle mesh. The float constructor takes positions only (3
+floats at location 0), the same layout main.cpp started with, the
+vertex shader derives texture coordinates from the position, so a quad
+from -0.5 to 0.5 maps to 0..1. Meshes from a .mesh file also have
+normals and texture coordinates, usually quantized, see meshfile.h.
+Their shaders include meshdecode.glsl, draw() and drawInstanced() bind
+the mesh's own Mesh block (uniforms.h) for it.
+
+enableInstancing() adds a second buffer to the VAO holding InstanceData,
+with glVertexAttribDivisor set to 1 so those attributes advance once per
+instance instead of once per vertex. drawInstanced() then draws any
+number of copies with one glDrawElementsInstanced call.
+
+A mesh from a file can go into a GeometryHeap instead of buffers of its
+own, VAO is then the heap's. Those can't be instanced (the instance
+attributes would land on every mesh in the heap), and draw through
+firstIndex() and baseVertex(), which change when the heap defragments.
+*/
+class Mesh {
+public:
+    Mesh(const float *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount);
+    // Any interleaved layout. indexType is GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+    Mesh(const void *vertices, size_t vertexCount, GLsizei stride, const VertexAttribute *attributes,
+         size_t attributeCount, const void *indices, size_t indexCount, GLenum indexType);
+    // One LOD of an open file, uploaded straight from the mapping. Into
+    // heap when given and it takes the file's layout, else own buffers.
+    Mesh(const MeshFile &file, uint32_t lod, GeometryHeap *heap = NULL);
+    ~Mesh();
+
+    // Binds the Mesh block, for drawing the VAO some other way.
+    void bindDecode() const;
+
+    // One object, per object data comes from the Object block.
+    void draw() const;
+
+    // Reserve room for maxInstances and hook the instance attributes
+    // into the VAO. Only needed once per mesh.
+    void enableInstancing(size_t maxInstances);
+    // Upload the instance data and draw them all in one call. count is
+    // clamped to what enableInstancing() reserved.
+    void drawInstanced(const InstanceData *instances, size_t count);
+    // Just the upload, for drawing the instances some other way (e.g.
+    // MultiDraw, one draw per instance via baseInstance). Returns the
+    // count actually uploaded.
+    size_t uploadInstances(const InstanceData *instances, size_t count);
+
+    // How enableInstancing() points locations 3-8 into InstanceData.
+    static const VertexAttribute INSTANCE_ATTRIBUTES[6];
+    // Vertex layouts of .mesh files, MESH_VERTEX_PNT and _PACKED, for
+    // making a GeometryHeap for them.
+    static const VertexAttribute FILE_LAYOUT[3];
+    static const VertexAttribute PACKED_LAYOUT[3];
+    unsigned int instanceBuffer() const { return instanceVBO; }
+    GLsizei indices() const { return indexCount; }
+    GLenum indexFormat() const { return indexType; }
+    // Where the mesh is in the VAO's buffers, 0 with buffers of its own.
+    GLuint firstIndex() const;
+    GLint baseVertex() const;
+
+    unsigned int VAO;
+
+    // Dequantization, identity for float vertices.
+    MeshUniforms decode;
+
+private:
+    unsigned int VBO, EBO, instanceVBO;
+    GeometryHeap *heap;
+    GeometryRange *range;  // in heap, NULL with own buffers
+    UniformBuffer decodeBlock;
+    GLsizei indexCount;
+    GLenum indexType;
+    size_t maxInstances;
+
+    void init(const void *vertices, size_t vertexCount, GLsizei stride, const VertexAttribute *attributes,
+              size_t attributeCount, const void *indices, size_t indexCount, GLenum indexType,
+              GeometryHeap *heap = NULL);
+
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+};
+
+/*
+One LOD of a .mesh file through the AssetLoader. The worker maps the
+file, checks it and checksums the LOD's blobs, create() uploads them
+from the mapping and unmaps. Only that LOD is ever read, so load the
+coarse one first and ask for finer ones when they're needed, each is
+its own asset. Drop the last handle on the GL thread, the mesh goes
+with it.
+*/
+class MeshAsset : public Asset {
+public:
+    MeshAsset(const std::string &path, uint32_t lod, GeometryHeap *heap = NULL)
+        : path(path), lod(lod), mesh(NULL), heap(heap) {}
+    ~MeshAsset() { delete mesh; }
+
+    std::string path;
+    uint32_t lod;
+    Mesh *mesh;
+    GeometryHeap *heap;     // where create() puts the mesh, if anywhere
+
+protected:
+    MeshFile file;
+    bool read();
+    bool create();
+};
+
+typedef std::shared_ptr<MeshAsset> MeshHandle;
+
+#endif
@@ -0,0 +1,396 @@
+#include "meshfile.h"
+
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MESHFILE_MMAP 1
+#endif
+
+uint32_t meshChecksum(const void *data, size_t size, uint32_t crc) {
+    // Built once on first use, C++11 makes the initialization thread safe
+    // (loader workers verify files in parallel).
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    const unsigned char *p = (const unsigned char*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint16_t floatToHalf(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if (((bits >> 23) & 0xFF) == 0xFF) // inf stays inf, NaN stays NaN
+        return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+    if (exponent >= 31)
+        return (uint16_t)(sign | 0x7C00);
+    if (exponent <= 0) {
+        // Denormal or zero. Shift the implicit 1 in and round.
+        if (exponent < -10)
+            return (uint16_t)sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1)))
+            half++;
+        return (uint16_t)(sign | half);
+    }
+    uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    // Rounding up may carry into the exponent, which is still right.
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return (uint16_t)(sign | half);
+}
+
+float halfToFloat(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Denormal, normalize it.
+            exponent = 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            mantissa &= 0x3FF;
+            bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        }
+    } else if (exponent == 31) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+// Signed 10 bit field, -511..511 so both GL conversion rules agree on
+// where 0 and +-1 are.
+static uint32_t snorm10(float v) {
+    if (v > 1.0f) v = 1.0f;
+    if (v < -1.0f) v = -1.0f;
+    int i = (int)lroundf(v * 511.0f);
+    return (uint32_t)i & 0x3FF;
+}
+
+uint32_t packOctahedral(const float normal[3]) {
+    // Project onto the octahedron |x| + |y| + |z| = 1, then fold the
+    // lower half over the diagonals onto the outer triangles.
+    float sum = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if (sum <= 0.0f)
+        return 0;
+    float x = normal[0] / sum, y = normal[1] / sum;
+    if (normal[2] < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+    return snorm10(x) | (snorm10(y) << 10);
+}
+
+void unpackOctahedral(uint32_t packed, float normal[3]) {
+    // Sign extend the two fields, same math as decodeNormal() in
+    // meshdecode.glsl.
+    int ix = (int)(packed << 22) >> 22;
+    int iy = (int)(packed << 12) >> 22;
+    float x = ix / 511.0f, y = iy / 511.0f;
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    float t = z < 0.0f ? -z : 0.0f;
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+    float len = sqrtf(x * x + y * y + z * z);
+    normal[0] = x / len;
+    normal[1] = y / len;
+    normal[2] = z / len;
+}
+
+static uint64_t alignUp(uint64_t offset) {
+    return (offset + MESH_FILE_ALIGN - 1) & ~(uint64_t)(MESH_FILE_ALIGN - 1);
+}
+
+// The vertex blob as it goes into the file.
+static void encodeVertices(const MeshFileHeader &header, const std::vector<MeshFileVertex> &vertices,
+                           std::vector<unsigned char> &out) {
+    out.resize(vertices.size() * header.vertexStride);
+    if (header.vertexFormat == MESH_VERTEX_PNT) {
+        if (!vertices.empty())
+            memcpy(out.data(), vertices.data(), out.size());
+        return;
+    }
+
+    float center[3], inverseExtent[3], uvScale[2];
+    for (int k = 0; k < 3; k++) {
+        center[k] = (header.boundsMin[k] + header.boundsMax[k]) * 0.5f;
+        float extent = (header.boundsMax[k] - header.boundsMin[k]) * 0.5f;
+        inverseExtent[k] = extent > 0.0f ? 1.0f / extent : 0.0f;
+    }
+    for (int k = 0; k < 2; k++) {
+        float range = header.uvMax[k] - header.uvMin[k];
+        uvScale[k] = range > 0.0f ? 65535.0f / range : 0.0f;
+    }
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const MeshFileVertex &v = vertices[i];
+        MeshPackedVertex p;
+        for (int k = 0; k < 3; k++)
+            p.position[k] = floatToHalf((v.position[k] - center[k]) * inverseExtent[k]);
+        p.pad = 0;
+        p.normal = packOctahedral(v.normal);
+        for (int k = 0; k < 2; k++)
+            p.uv[k] = (uint16_t)lroundf((v.uv[k] - header.uvMin[k]) * uvScale[k]);
+        memcpy(&out[i * sizeof(p)], &p, sizeof(p));
+    }
+}
+
+bool writeMeshFile(const std::string &path, const std::vector<MeshData> &lods, MeshVertexFormat format) {
+    if (lods.empty() || lods.size() > MESH_FILE_MAX_LODS) {
+        std::cout << "ERROR::MESHFILE::BAD_LOD_COUNT " << lods.size() << std::endl;
+        return false;
+    }
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertexFormat = format;
+    header.vertexStride = format == MESH_VERTEX_PACKED ? sizeof(MeshPackedVertex) : sizeof(MeshFileVertex);
+    header.lodCount = (uint32_t)lods.size();
+    // Bounds first, packing is relative to them.
+    bool first = true;
+    for (const MeshData &mesh : lods) {
+        for (const MeshFileVertex &v : mesh.vertices) {
+            for (int k = 0; k < 3; k++) {
+                if (first || v.position[k] < header.boundsMin[k]) header.boundsMin[k] = v.position[k];
+                if (first || v.position[k] > header.boundsMax[k]) header.boundsMax[k] = v.position[k];
+            }
+            for (int k = 0; k < 2; k++) {
+                if (first || v.uv[k] < header.uvMin[k]) header.uvMin[k] = v.uv[k];
+                if (first || v.uv[k] > header.uvMax[k]) header.uvMax[k] = v.uv[k];
+            }
+            first = false;
+        }
+    }
+
+    // Lay out the blobs and narrow the indices first, the table needs
+    // offsets and checksums.
+    std::vector<MeshFileLod> table(lods.size());
+    std::vector<std::vector<unsigned char> > vertexBlobs(lods.size());
+    std::vector<std::vector<unsigned char> > indexBlobs(lods.size());
+    uint64_t offset = alignUp(sizeof(MeshFileHeader) + sizeof(MeshFileLod) * lods.size());
+    for (size_t i = 0; i < lods.size(); i++) {
+        const MeshData &mesh = lods[i];
+        MeshFileLod &lod = table[i];
+        memset(&lod, 0, sizeof(lod));
+        lod.vertexCount = (uint32_t)mesh.vertices.size();
+        lod.indexCount = (uint32_t)mesh.indices.size();
+        lod.indexSize = mesh.vertices.size() <= 65536 ? 2 : 4;
+
+        std::vector<unsigned char> &indices = indexBlobs[i];
+        indices.resize(mesh.indices.size() * lod.indexSize);
+        for (size_t k = 0; k < mesh.indices.size(); k++) {
+            if (lod.indexSize == 2) {
+                uint16_t index = (uint16_t)mesh.indices[k];
+                memcpy(&indices[k * 2], &index, 2);
+            } else {
+                memcpy(&indices[k * 4], &mesh.indices[k], 4);
+            }
+        }
+
+        std::vector<unsigned char> &vertices = vertexBlobs[i];
+        encodeVertices(header, mesh.vertices, vertices);
+
+        lod.vertexOffset = offset;
+        offset = alignUp(offset + vertices.size());
+        lod.indexOffset = offset;
+        offset = alignUp(offset + indices.size());
+        lod.vertexChecksum = meshChecksum(vertices.data(), vertices.size());
+        lod.indexChecksum = meshChecksum(indices.data(), indices.size());
+    }
+    header.lodChecksum = meshChecksum(table.data(), table.size() * sizeof(MeshFileLod));
+    header.headerChecksum = meshChecksum(&header, offsetof(MeshFileHeader, headerChecksum));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "ERROR::MESHFILE::CANT_WRITE " << path << std::endl;
+        return false;
+    }
+    static const char zeros[MESH_FILE_ALIGN] = {};
+    uint64_t written = 0;
+    // Pads up to the next blob, then writes it.
+    auto put = [&](uint64_t at, const void *bytes, size_t size) {
+        file.write(zeros, (std::streamsize)(at - written));
+        file.write((const char*)bytes, (std::streamsize)size);
+        written = at + size;
+    };
+    put(0, &header, sizeof(header));
+    put(written, table.data(), table.size() * sizeof(MeshFileLod));
+    for (size_t i = 0; i < lods.size(); i++) {
+        put(table[i].vertexOffset, vertexBlobs[i].data(), vertexBlobs[i].size());
+        put(table[i].indexOffset, indexBlobs[i].data(), indexBlobs[i].size());
+    }
+    put(offset, NULL, 0);
+    if (!file) {
+        std::cout << "ERROR::MESHFILE::CANT_WRITE " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+MeshFile::MeshFile() {
+    data = NULL;
+    size = 0;
+    mapped = false;
+}
+
+MeshFile::~MeshFile() {
+    close();
+}
+
+bool MeshFile::open(const std::string &path) {
+    close();
+    this->path = path;
+#if defined(MESHFILE_MMAP)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "ERROR::MESHFILE::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *p = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            data = (const unsigned char*)p;
+            size = (size_t)info.st_size;
+            mapped = true;
+        }
+    }
+    // The mapping keeps the file alive on its own.
+    ::close(fd);
+#endif
+    if (!data) {
+        // No mmap here (or it failed), read the whole thing instead.
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            std::cout << "ERROR::MESHFILE::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+            return false;
+        }
+        copy.resize((size_t)file.tellg());
+        file.seekg(0);
+        file.read((char*)copy.data(), (std::streamsize)copy.size());
+        if (!file || copy.empty()) {
+            std::cout << "ERROR::MESHFILE::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+            copy.clear();
+            return false;
+        }
+        data = copy.data();
+        size = copy.size();
+    }
+    if (!validate()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MeshFile::close() {
+#if defined(MESHFILE_MMAP)
+    if (mapped)
+        munmap((void*)data, size);
+#endif
+    data = NULL;
+    size = 0;
+    mapped = false;
+    copy.clear();
+    copy.shrink_to_fit();
+}
+
+bool MeshFile::validate() {
+    if (size < sizeof(MeshFileHeader)) {
+        std::cout << "ERROR::MESHFILE::TRUNCATED " << path << std::endl;
+        return false;
+    }
+    const MeshFileHeader &h = header();
+    if (h.magic != MESH_FILE_MAGIC) {
+        std::cout << "ERROR::MESHFILE::NOT_A_MESH_FILE " << path << std::endl;
+        return false;
+    }
+    if (h.version != MESH_FILE_VERSION) {
+        std::cout << "ERROR::MESHFILE::VERSION " << path << ": " << h.version
+                  << ", expected " << MESH_FILE_VERSION << ", reconvert it" << std::endl;
+        return false;
+    }
+    if (h.headerChecksum != meshChecksum(&h, offsetof(MeshFileHeader, headerChecksum))) {
+        std::cout << "ERROR::MESHFILE::BAD_CHECKSUM " << path << ": header" << std::endl;
+        return false;
+    }
+    bool formatOk = (h.vertexFormat == MESH_VERTEX_PNT && h.vertexStride == sizeof(MeshFileVertex))
+                 || (h.vertexFormat == MESH_VERTEX_PACKED && h.vertexStride == sizeof(MeshPackedVertex));
+    if (!formatOk || h.lodCount == 0 || h.lodCount > MESH_FILE_MAX_LODS) {
+        std::cout << "ERROR::MESHFILE::BAD_HEADER " << path << std::endl;
+        return false;
+    }
+    size_t tableEnd = sizeof(MeshFileHeader) + h.lodCount * sizeof(MeshFileLod);
+    if (size < tableEnd) {
+        std::cout << "ERROR::MESHFILE::TRUNCATED " << path << std::endl;
+        return false;
+    }
+    if (h.lodChecksum != meshChecksum(&lod(0), h.lodCount * sizeof(MeshFileLod))) {
+        std::cout << "ERROR::MESHFILE::BAD_CHECKSUM " << path << ": LOD table" << std::endl;
+        return false;
+    }
+    // Everything the pointers can reach has to be inside the file.
+    for (uint32_t i = 0; i < h.lodCount; i++) {
+        const MeshFileLod &l = lod(i);
+        bool ok = (l.indexSize == 2 || l.indexSize == 4)
+               && l.vertexOffset % MESH_FILE_ALIGN == 0 && l.indexOffset % MESH_FILE_ALIGN == 0
+               && l.vertexOffset >= tableEnd && l.indexOffset >= tableEnd
+               && l.vertexOffset <= size && vertexBytes(i) <= size - l.vertexOffset
+               && l.indexOffset <= size && indexBytes(i) <= size - l.indexOffset;
+        if (!ok) {
+            std::cout << "ERROR::MESHFILE::BAD_LOD " << path << ": " << i << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MeshFile::verify(uint32_t i) const {
+    if (!data || i >= lodCount())
+        return false;
+    const MeshFileLod &l = lod(i);
+    if (meshChecksum(vertices(i), vertexBytes(i)) != l.vertexChecksum
+        || meshChecksum(indices(i), indexBytes(i)) != l.indexChecksum) {
+        std::cout << "ERROR::MESHFILE::BAD_CHECKSUM " << path << ": LOD " << i << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,147 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+Binary mesh file (.mesh), made offline by tools/meshconv so the game
+never parses text geometry.
+
+  MeshFileHeader
+  MeshFileLod[lodCount]     LOD 0 is the most detailed
+  vertex and index blobs, each starting on a MESH_FILE_ALIGN boundary
+
+Little endian, no pointers, blobs are exactly what glBufferData wants.
+MeshFile maps the file and hands out pointers into the mapping, so
+loading is a header check and a copy into GL, nothing in between.
+Pages of LODs nobody asks for are never read from disk.
+
+Vertices are either plain floats or quantized to half the size
+(MESH_VERTEX_PACKED, the converter's default):
+  position  3 half floats of (p - center) / half extent, center and
+            extent come from the header bounds
+  normal    octahedral encoding in the x and y of a signed normalized
+            GL_INT_2_10_10_10_REV, z and w are 0
+  uv        2 unsigned normalized 16 bit values over the header's uv range
+Shaders include meshdecode.glsl to undo this, Mesh sets its uniforms.
+
+Bump MESH_FILE_VERSION whenever the layout changes, old files are
+rejected instead of misread. Reconvert with `make meshes`.
+*/
+const uint32_t MESH_FILE_MAGIC = 0x4853454D; // "MESH"
+const uint32_t MESH_FILE_VERSION = 2;
+const uint32_t MESH_FILE_ALIGN = 64;
+const uint32_t MESH_FILE_MAX_LODS = 16;
+
+enum MeshVertexFormat {
+    MESH_VERTEX_PNT = 1,   // MeshFileVertex, 32 bytes
+    MESH_VERTEX_PACKED = 2 // MeshPackedVertex, 16 bytes
+};
+
+// Attribute locations: 0 = position, 1 = normal, 2 = texture coordinates.
+struct MeshFileVertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+// Same attribute locations, quantized as described above.
+struct MeshPackedVertex {
+    uint16_t position[3];  // half floats
+    uint16_t pad;
+    uint32_t normal;       // 2_10_10_10, x and y used
+    uint16_t uv[2];        // unorm16
+};
+
+struct MeshFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexFormat;   // MeshVertexFormat
+    uint32_t vertexStride;
+    uint32_t lodCount;
+    uint32_t lodChecksum;    // of the MeshFileLod table
+    float boundsMin[3];      // all LODs
+    float boundsMax[3];
+    float uvMin[2];          // all LODs, for unpacking uv
+    float uvMax[2];
+    uint32_t reserved[3];
+    uint32_t headerChecksum; // of everything above
+};
+
+struct MeshFileLod {
+    uint64_t vertexOffset;   // from the start of the file
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;      // bytes, 2 or 4
+    uint32_t vertexChecksum;
+    uint32_t indexChecksum;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(MeshFileVertex) == 32, "MeshFileVertex is part of the file format");
+static_assert(sizeof(MeshPackedVertex) == 16, "MeshPackedVertex is part of the file format");
+static_assert(sizeof(MeshFileHeader) == 80, "MeshFileHeader is part of the file format");
+static_assert(sizeof(MeshFileLod) == 40, "MeshFileLod is part of the file format");
+
+// CRC-32 (the zlib one). Pass the previous result to continue a stream.
+uint32_t meshChecksum(const void *data, size_t size, uint32_t crc = 0);
+
+// Quantization helpers, shared by the writer and anything that has to
+// read packed vertices on the CPU.
+uint16_t floatToHalf(float f);  // round to nearest even
+float halfToFloat(uint16_t h);
+uint32_t packOctahedral(const float normal[3]);
+void unpackOctahedral(uint32_t packed, float normal[3]);
+
+// One LOD on the CPU side, what the converter builds.
+struct MeshData {
+    std::vector<MeshFileVertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Writes lods (most detailed first). Indices are stored 16 bit when a
+// LOD has few enough vertices.
+bool writeMeshFile(const std::string &path, const std::vector<MeshData> &lods,
+                   MeshVertexFormat format = MESH_VERTEX_PACKED);
+
+// A .mesh file mapped read only. Pointers stay valid until close().
+class MeshFile {
+public:
+    MeshFile();
+    ~MeshFile();
+
+    // Maps the file and checks the header and LOD table, not the blobs.
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return data != NULL; }
+
+    // Checksums one LOD's blobs. Only touches that LOD's pages.
+    bool verify(uint32_t lod) const;
+
+    const MeshFileHeader &header() const { return *(const MeshFileHeader*)data; }
+    uint32_t lodCount() const { return header().lodCount; }
+    const MeshFileLod &lod(uint32_t i) const { return ((const MeshFileLod*)(data + sizeof(MeshFileHeader)))[i]; }
+    const void *vertices(uint32_t i) const { return data + lod(i).vertexOffset; }
+    const void *indices(uint32_t i) const { return data + lod(i).indexOffset; }
+    size_t vertexBytes(uint32_t i) const { return (size_t)lod(i).vertexCount * header().vertexStride; }
+    size_t indexBytes(uint32_t i) const { return (size_t)lod(i).indexCount * lod(i).indexSize; }
+
+    std::string path;
+
+private:
+    const unsigned char *data;
+    size_t size;
+    bool mapped;              // false when read into copy instead
+    std::vector<unsigned char> copy;
+
+    bool validate();
+
+    MeshFile(const MeshFile&) = delete;
+    MeshFile& operator=(const MeshFile&) = delete;
+};
+
+#endif
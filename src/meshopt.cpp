@@ -0,0 +1,285 @@
+#include "meshopt.h"
+
+#include <algorithm>
+#include <math.h>
+
+float meshACMR(const std::vector<uint32_t> &indices, size_t vertexCount, unsigned int cacheSize) {
+    if (indices.size() < 3)
+        return 0.0f;
+    // FIFO: a hit doesn't move the vertex. Timestamps instead of a queue,
+    // a vertex is in the cache while fewer than cacheSize misses came
+    // after it.
+    std::vector<size_t> loadedAt(vertexCount, 0);
+    size_t misses = 0;
+    for (uint32_t v : indices) {
+        if (loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize) {
+            misses++;
+            loadedAt[v] = misses;
+        }
+    }
+    return (float)misses / (float)(indices.size() / 3);
+}
+
+// Forsyth's scoring, the constants are the ones from his write-up.
+static const int CACHE_SIZE = 32;
+static const int MAX_VALENCE = 64; // past this the boost is ~0 anyway
+
+static float vertexScore(int cachePosition, int valence) {
+    static float cacheScore[CACHE_SIZE];
+    static float valenceScore[MAX_VALENCE];
+    static bool built = false;
+    if (!built) {
+        for (int i = 0; i < CACHE_SIZE; i++) {
+            // The last triangle's three are scored flat, so the order
+            // inside it doesn't matter.
+            if (i < 3)
+                cacheScore[i] = 0.75f;
+            else
+                cacheScore[i] = powf(1.0f - (float)(i - 3) / (CACHE_SIZE - 3), 1.5f);
+        }
+        valenceScore[0] = 0.0f;
+        for (int i = 1; i < MAX_VALENCE; i++)
+            valenceScore[i] = 2.0f / sqrtf((float)i);
+        built = true;
+    }
+    if (valence == 0)
+        return -1.0f; // nothing left to draw with it
+    float score = cachePosition >= 0 && cachePosition < CACHE_SIZE ? cacheScore[cachePosition] : 0.0f;
+    return score + valenceScore[valence < MAX_VALENCE ? valence : MAX_VALENCE - 1];
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles of each vertex. The first valence[v] of a vertex's
+    // entries are the ones not drawn yet.
+    std::vector<uint32_t> offset(vertexCount + 1, 0);
+    for (uint32_t v : indices)
+        offset[v + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offset[v + 1] += offset[v];
+    std::vector<uint32_t> triangles(indices.size());
+    std::vector<uint32_t> valence(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); i++) {
+        uint32_t v = indices[i];
+        triangles[offset[v] + valence[v]++] = (uint32_t)(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, (int)valence[v]);
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    int best = (int)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(CACHE_SIZE + 3);
+    nextCache.reserve(CACHE_SIZE + 3);
+    std::vector<uint32_t> out;
+    out.reserve(indices.size());
+    size_t cursor = 0; // everything before it has been emitted
+
+    for (size_t n = 0; n < triangleCount; n++) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left, start somewhere new.
+            while (emitted[cursor])
+                cursor++;
+            best = (int)cursor;
+        }
+        const uint32_t *tri = &indices[best * 3];
+        out.insert(out.end(), tri, tri + 3);
+        emitted[best] = true;
+
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = tri[k];
+            uint32_t *list = &triangles[offset[v]];
+            uint32_t *end = list + valence[v];
+            uint32_t *found = std::find(list, end, (uint32_t)best);
+            *found = *(end - 1);
+            valence[v]--;
+        }
+
+        // The triangle's vertices go to the front, the rest shift back.
+        nextCache.assign(tri, tri + 3);
+        for (uint32_t v : cache)
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                nextCache.push_back(v);
+        for (size_t i = CACHE_SIZE; i < nextCache.size(); i++)
+            cachePosition[nextCache[i]] = -1;
+        if (nextCache.size() > (size_t)CACHE_SIZE)
+            nextCache.resize(CACHE_SIZE);
+        for (size_t i = 0; i < nextCache.size(); i++)
+            cachePosition[nextCache[i]] = (int)i;
+
+        // Rescore what moved (evicted vertices too) and pass the change
+        // on to their remaining triangles.
+        auto rescore = [&](uint32_t v) {
+            float s = vertexScore(cachePosition[v], (int)valence[v]);
+            float delta = s - score[v];
+            score[v] = s;
+            for (uint32_t i = 0; i < valence[v]; i++)
+                triangleScore[triangles[offset[v] + i]] += delta;
+        };
+        for (uint32_t v : cache)
+            if (cachePosition[v] < 0)
+                rescore(v);
+        for (uint32_t v : nextCache)
+            rescore(v);
+        cache.swap(nextCache);
+
+        best = -1;
+        float bestScore = -1.0f;
+        for (uint32_t v : cache) {
+            for (uint32_t i = 0; i < valence[v]; i++) {
+                uint32_t t = triangles[offset[v] + i];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = (int)t;
+                }
+            }
+        }
+    }
+    indices.swap(out);
+}
+
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<MeshFileVertex> &vertices, float threshold) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    // Hard boundaries: triangles whose three vertices all miss, the cache
+    // was going to start over there anyway.
+    std::vector<size_t> loadedAt(vertices.size(), 0);
+    std::vector<unsigned char> missed(triangleCount, 0);
+    std::vector<size_t> hard;
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = indices[t * 3 + k];
+            if (loadedAt[v] == 0 || misses - loadedAt[v] >= (size_t)CACHE_SIZE) {
+                misses++;
+                loadedAt[v] = misses;
+                missed[t]++;
+            }
+        }
+        if (t == 0 || missed[t] == 3)
+            hard.push_back(t);
+    }
+    hard.push_back(triangleCount);
+
+    // Soft boundaries: inside a hard cluster, split again wherever the
+    // piece so far has an ACMR (with the cache starting empty) within
+    // threshold of the whole cluster's. Splitting empties the simulated
+    // cache, that's what it costs.
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); h++) {
+        size_t start = hard[h], end = hard[h + 1];
+        size_t clusterMisses = 0;
+        for (size_t t = start; t < end; t++)
+            clusterMisses += missed[t];
+        float target = (float)clusterMisses / (float)(end - start) * threshold;
+
+        misses += CACHE_SIZE;
+        size_t pieceStart = start, pieceMisses = 0;
+        clusters.push_back(start);
+        for (size_t t = start; t < end; t++) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = indices[t * 3 + k];
+                if (loadedAt[v] == 0 || misses - loadedAt[v] >= (size_t)CACHE_SIZE) {
+                    misses++;
+                    pieceMisses++;
+                    loadedAt[v] = misses;
+                }
+            }
+            if (t + 1 < end && (float)pieceMisses / (float)(t + 1 - pieceStart) <= target) {
+                clusters.push_back(t + 1);
+                pieceStart = t + 1;
+                pieceMisses = 0;
+                misses += CACHE_SIZE;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // How much each cluster faces away from the mesh center, using area
+    // weighted centroids and normals.
+    double center[3] = { 0.0, 0.0, 0.0 };
+    double totalArea = 0.0;
+    size_t clusterCount = clusters.size() - 1;
+    std::vector<float> sortKey(clusterCount);
+    std::vector<float> clusterData(clusterCount * 7); // centroid, normal, area
+    for (size_t c = 0; c < clusterCount; c++) {
+        float *d = &clusterData[c * 7];
+        std::fill(d, d + 7, 0.0f);
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            const float *a = vertices[indices[t * 3]].position;
+            const float *b = vertices[indices[t * 3 + 1]].position;
+            const float *p = vertices[indices[t * 3 + 2]].position;
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e2[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            float area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5f;
+            for (int k = 0; k < 3; k++) {
+                d[k] += (a[k] + b[k] + p[k]) / 3.0f * area;
+                d[3 + k] += n[k];
+            }
+            d[6] += area;
+        }
+        for (int k = 0; k < 3; k++)
+            center[k] += d[k];
+        totalArea += d[6];
+    }
+    if (totalArea <= 0.0)
+        return;
+    for (int k = 0; k < 3; k++)
+        center[k] /= totalArea;
+    for (size_t c = 0; c < clusterCount; c++) {
+        const float *d = &clusterData[c * 7];
+        float len = sqrtf(d[3] * d[3] + d[4] * d[4] + d[5] * d[5]);
+        float key = 0.0f;
+        if (d[6] > 0.0f && len > 0.0f)
+            for (int k = 0; k < 3; k++)
+                key += (d[k] / d[6] - (float)center[k]) * d[3 + k] / len;
+        sortKey[c] = key;
+    }
+
+    // Outward facing first.
+    std::vector<uint32_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+        order[c] = (uint32_t)c;
+    std::stable_sort(order.begin(), order.end(), [&sortKey](uint32_t a, uint32_t b) {
+        return sortKey[a] > sortKey[b];
+    });
+    std::vector<uint32_t> out;
+    out.reserve(indices.size());
+    for (uint32_t c : order)
+        out.insert(out.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+    indices.swap(out);
+}
+
+void optimizeVertexFetch(MeshData &mesh) {
+    const uint32_t UNUSED = 0xFFFFFFFFu;
+    std::vector<uint32_t> remap(mesh.vertices.size(), UNUSED);
+    std::vector<MeshFileVertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (uint32_t &i : mesh.indices) {
+        if (remap[i] == UNUSED) {
+            remap[i] = (uint32_t)vertices.size();
+            vertices.push_back(mesh.vertices[i]);
+        }
+        i = remap[i];
+    }
+    mesh.vertices.swap(vertices);
+}
+
+void optimizeMesh(MeshData &mesh, bool overdraw) {
+    optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    if (overdraw)
+        optimizeOverdraw(mesh.indices, mesh.vertices);
+    optimizeVertexFetch(mesh);
+}
@@ -0,0 +1,45 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "meshfile.h"
+
+/*
+Index and vertex reordering for imported meshes, run by tools/meshconv
+before writing a .mesh file. Nothing here changes what gets drawn, only
+the order.
+
+  optimizeVertexCache  Tom Forsyth's linear speed vertex cache
+                       optimisation: greedily emits the triangle whose
+                       vertices score best against a simulated LRU cache,
+                       favouring recent vertices and ones with few
+                       triangles left.
+  optimizeOverdraw     Cuts the cache ordered triangles into clusters
+                       where the cache starts over anyway, then draws the
+                       clusters facing away from the mesh center first,
+                       so on average outer surfaces hide inner ones.
+                       Costs a little ACMR, see the threshold.
+  optimizeVertexFetch  Renumbers vertices in the order the indices first
+                       use them, so fetches walk memory forward. Drops
+                       vertices nothing uses. Run it last.
+
+ACMR (average cache miss ratio) is vertex shader runs per triangle with
+a FIFO post-transform cache of cacheSize, 3 is the worst, around 0.6 is
+about as good as a regular grid gets.
+*/
+float meshACMR(const std::vector<uint32_t> &indices, size_t vertexCount, unsigned int cacheSize = 32);
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount);
+// Only moves a cluster when ACMR stays within threshold times the cache
+// ordered result.
+void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<MeshFileVertex> &vertices,
+                      float threshold = 1.05f);
+void optimizeVertexFetch(MeshData &mesh);
+
+// All three in the right order.
+void optimizeMesh(MeshData &mesh, bool overdraw = true);
+
+#endif
@@ -0,0 +1,140 @@
+#include "multidraw.h"
+#include "glad_ext.h"
+#include "glstate.h"
+
+MultiDraw::Path MultiDraw::best() {
+    if (GLAD_GL_ARB_draw_indirect && GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance)
+        return PATH_INDIRECT;
+    return PATH_MULTI_DRAW;
+}
+
+const char *MultiDraw::pathName(Path path) {
+    switch (path) {
+    case PATH_INDIRECT: return "indirect";
+    case PATH_MULTI_DRAW: return "multi-draw";
+    default: return "draw loop";
+    }
+}
+
+MultiDraw::MultiDraw(size_t maxCommands) {
+    this->path = best();
+    this->indirectBuffer = 0;
+    this->indirectCapacity = 0;
+    this->instanceBuffer = 0;
+    this->instanceStride = 0;
+    commands.reserve(maxCommands);
+    counts.reserve(maxCommands);
+    offsets.reserve(maxCommands);
+    baseVertices.reserve(maxCommands);
+    stats.calls = 0;
+    stats.commands = 0;
+    stats.path = path;
+}
+
+MultiDraw::~MultiDraw() {
+    if (indirectBuffer)
+        GLState::deleteBuffers(1, &indirectBuffer);
+}
+
+void MultiDraw::add(GLuint count, GLuint firstIndex, GLint baseVertex, GLuint instanceCount, GLuint baseInstance) {
+    DrawElementsCommand c = { count, instanceCount, firstIndex, baseVertex, baseInstance };
+    commands.push_back(c);
+}
+
+void MultiDraw::setInstanceLayout(unsigned int buffer, GLsizei stride, const VertexAttribute *attributes, size_t count) {
+    instanceBuffer = buffer;
+    instanceStride = stride;
+    instanceAttributes.assign(attributes, attributes + count);
+}
+
+void MultiDraw::submit(GLenum mode, GLenum indexType) {
+    stats.calls = 0;
+    stats.commands = (unsigned int)commands.size();
+    if (commands.empty())
+        return;
+    size_t indexSize = indexType == GL_UNSIGNED_SHORT ? 2 : indexType == GL_UNSIGNED_BYTE ? 1 : 4;
+
+    // Lower the path for what this batch needs and the driver has.
+    Path p = path;
+    if (p == PATH_INDIRECT && best() != PATH_INDIRECT)
+        p = PATH_MULTI_DRAW;
+    if (p == PATH_MULTI_DRAW) {
+        for (const DrawElementsCommand &c : commands) {
+            if (c.instanceCount != 1 || c.baseInstance != 0) {
+                p = PATH_LOOP;
+                break;
+            }
+        }
+    }
+    stats.path = p;
+
+    if (p == PATH_INDIRECT)
+        drawIndirect(mode, indexType);
+    else if (p == PATH_MULTI_DRAW)
+        drawMulti(mode, indexType, indexSize);
+    else
+        drawLoop(mode, indexType, indexSize);
+    commands.clear();
+}
+
+void MultiDraw::drawIndirect(GLenum mode, GLenum indexType) {
+    if (!indirectBuffer)
+        glGenBuffers(1, &indirectBuffer);
+    GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    // Orphan, last batch's commands may still be read. Grows to the
+    // biggest batch and stays there.
+    if (commands.size() > indirectCapacity)
+        indirectCapacity = commands.capacity();
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectCapacity * sizeof(DrawElementsCommand), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsCommand), commands.data());
+    glMultiDrawElementsIndirect(mode, indexType, (void*)0, (GLsizei)commands.size(), sizeof(DrawElementsCommand));
+    stats.calls++;
+}
+
+void MultiDraw::drawMulti(GLenum mode, GLenum indexType, size_t indexSize) {
+    counts.clear();
+    offsets.clear();
+    baseVertices.clear();
+    for (const DrawElementsCommand &c : commands) {
+        counts.push_back((GLsizei)c.count);
+        offsets.push_back((const void*)(c.firstIndex * indexSize));
+        baseVertices.push_back(c.baseVertex);
+    }
+    glMultiDrawElementsBaseVertex(mode, counts.data(), indexType, offsets.data(), (GLsizei)counts.size(),
+                                  baseVertices.data());
+    stats.calls++;
+}
+
+void MultiDraw::drawLoop(GLenum mode, GLenum indexType, size_t indexSize) {
+    bool baseInstances = GLAD_GL_ARB_base_instance != 0;
+    GLuint pointedAt = 0;
+    for (const DrawElementsCommand &c : commands) {
+        const void *offset = (const void*)(c.firstIndex * indexSize);
+        if (baseInstances) {
+            glDrawElementsInstancedBaseVertexBaseInstance(mode, (GLsizei)c.count, indexType, offset,
+                                                          (GLsizei)c.instanceCount, c.baseVertex, c.baseInstance);
+        } else {
+            if (c.baseInstance != pointedAt) {
+                pointInstances(c.baseInstance);
+                pointedAt = c.baseInstance;
+            }
+            glDrawElementsInstancedBaseVertex(mode, (GLsizei)c.count, indexType, offset,
+                                              (GLsizei)c.instanceCount, c.baseVertex);
+        }
+        stats.calls++;
+    }
+    // Leave the VAO the way it was set up.
+    if (pointedAt != 0)
+        pointInstances(0);
+}
+
+// Instance attributes start at element baseInstance, as if GL had
+// applied it.
+void MultiDraw::pointInstances(GLuint baseInstance) {
+    if (!instanceBuffer)
+        return;
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    size_t start = (size_t)baseInstance * instanceStride;
+    for (const VertexAttribute &a : instanceAttributes)
+        glVertexAttribPointer(a.location, a.size, a.type, a.normalized, instanceStride, (void*)(start + a.offset));
+}
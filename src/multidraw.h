@@ -0,0 +1,99 @@
+#ifndef MULTIDRAW_H
+#define MULTIDRAW_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+#include <vector>
+
+#include "mesh.h"
+
+// One command in the layout glMultiDrawElementsIndirect reads.
+struct DrawElementsCommand {
+    GLuint count;          // indices
+    GLuint instanceCount;
+    GLuint firstIndex;     // in indices, not bytes
+    GLint baseVertex;
+    GLuint baseInstance;   // first instance attribute element
+};
+
+/*
+Many draws out of one vertex/index buffer pair in as few calls as the
+driver allows. Every command picks its own index range, base vertex
+and instances, so different meshes packed into shared buffers draw
+together, each with its own per instance data (baseInstance picks the
+InstanceData element).
+
+Paths, best first:
+  PATH_INDIRECT    commands go to a GL_DRAW_INDIRECT_BUFFER and one
+                   glMultiDrawElementsIndirect draws them all. Needs
+                   ARB_draw_indirect, ARB_multi_draw_indirect and
+                   ARB_base_instance (all core in 4.3).
+  PATH_MULTI_DRAW  one glMultiDrawElementsBaseVertex (core 3.2). It
+                   has no instances, batches that use them (instance
+                   count above 1 or a base instance) take the loop.
+  PATH_LOOP        one glDrawElementsInstancedBaseVertex per command.
+                   Without ARB_base_instance the base instance is
+                   emulated by pointing the instance attributes given
+                   to setInstanceLayout() at the right element.
+
+path starts at best() and can be lowered, e.g. to compare or to dodge
+a driver bug. Commands are kept between submits only as capacity,
+nothing is allocated once warm.
+*/
+class MultiDraw {
+public:
+    enum Path { PATH_LOOP, PATH_MULTI_DRAW, PATH_INDIRECT };
+    // What the current context supports. After gladLoadGLLoader().
+    static Path best();
+    static const char *pathName(Path path);
+
+    explicit MultiDraw(size_t maxCommands = 4096);
+    ~MultiDraw();
+
+    void add(GLuint count, GLuint firstIndex, GLint baseVertex, GLuint instanceCount = 1, GLuint baseInstance = 0);
+    void add(const DrawElementsCommand &command) { commands.push_back(command); }
+    size_t size() const { return commands.size(); }
+    void clear() { commands.clear(); }
+
+    // Instanced attributes of the VAO, for emulating base instances.
+    // Mesh::INSTANCE_ATTRIBUTES with Mesh::instanceBuffer() for meshes.
+    void setInstanceLayout(unsigned int buffer, GLsizei stride, const VertexAttribute *attributes, size_t count);
+
+    // Draws everything added with the VAO that's bound, then clears.
+    void submit(GLenum mode, GLenum indexType);
+
+    Path path;
+
+    // Last submit().
+    struct Stats {
+        unsigned int calls;     // draw calls made
+        unsigned int commands;
+        Path path;              // the one actually taken
+    };
+    Stats stats;
+
+private:
+    std::vector<DrawElementsCommand> commands;
+    unsigned int indirectBuffer;
+    size_t indirectCapacity;    // commands
+
+    // PATH_MULTI_DRAW arguments
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+
+    unsigned int instanceBuffer;
+    GLsizei instanceStride;
+    std::vector<VertexAttribute> instanceAttributes;
+
+    void drawIndirect(GLenum mode, GLenum indexType);
+    void drawMulti(GLenum mode, GLenum indexType, size_t indexSize);
+    void drawLoop(GLenum mode, GLenum indexType, size_t indexSize);
+    void pointInstances(GLuint baseInstance);
+
+    MultiDraw(const MultiDraw&) = delete;
+    MultiDraw& operator=(const MultiDraw&) = delete;
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string.h>
+#include <vector>
+
+FrameProfiler::FrameProfiler() {
+    regionCount = 0;
+    counterCount = 0;
+    frame = -1;
+    gpuOpen = -1;
+    for (int f = 0; f < HISTORY; f++) {
+        for (int r = 0; r < MAX_REGIONS; r++)
+            history[f][r].cpuMs = history[f][r].gpuMs = -1.0f;
+        for (int c = 0; c < MAX_COUNTERS; c++)
+            counts[f][c] = -1.0f;
+    }
+    memset(issued, 0, sizeof(issued));
+    for (int s = 0; s < LATENCY; s++)
+        slotFrame[s] = -1;
+
+    glGenQueries(LATENCY * MAX_REGIONS, &queries[0][0]);
+    gpuTiming = glGetError() == GL_NO_ERROR;
+
+    // Region 0 is the whole frame, its GPU time is the sum of the others.
+    region("frame");
+}
+
+FrameProfiler::~FrameProfiler() {
+    glDeleteQueries(LATENCY * MAX_REGIONS, &queries[0][0]);
+}
+
+FrameProfiler::Region FrameProfiler::region(const char *name) {
+    for (int r = 0; r < regionCount; r++)
+        if (names[r] == name)
+            return r;
+    if (regionCount == MAX_REGIONS)
+        return -1;
+    names[regionCount] = name;
+    return regionCount++;
+}
+
+FrameProfiler::Counter FrameProfiler::counter(const char *name) {
+    for (int c = 0; c < counterCount; c++)
+        if (counterNames[c] == name)
+            return c;
+    if (counterCount == MAX_COUNTERS)
+        return -1;
+    counterNames[counterCount] = name;
+    return counterCount++;
+}
+
+// Read back whatever finished from the frame that last used this slot.
+void FrameProfiler::resolve(int slot) {
+    long long done = slotFrame[slot];
+    if (done < 0 || frame - done >= HISTORY)
+        return;
+    Sample *samples = history[done % HISTORY];
+
+    float total = 0.0f;
+    bool complete = true;
+    for (int r = 1; r < regionCount; r++) {
+        if (!issued[slot][r])
+            continue;
+        issued[slot][r] = false;
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[slot][r], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            // Still not done LATENCY frames later, drop it rather than wait.
+            complete = false;
+            continue;
+        }
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[slot][r], GL_QUERY_RESULT, &ns);
+        samples[r].gpuMs = (float)(ns / 1.0e6);
+        total += samples[r].gpuMs;
+    }
+    if (complete)
+        samples[0].gpuMs = total;
+    slotFrame[slot] = -1;
+}
+
+void FrameProfiler::beginFrame() {
+    frame++;
+    int slot = (int)(frame % LATENCY);
+    if (gpuTiming)
+        resolve(slot);
+    slotFrame[slot] = frame;
+
+    Sample *samples = history[frame % HISTORY];
+    for (int r = 0; r < MAX_REGIONS; r++)
+        samples[r].cpuMs = samples[r].gpuMs = -1.0f;
+    for (int c = 0; c < MAX_COUNTERS; c++)
+        counts[frame % HISTORY][c] = -1.0f;
+    frameStart = Clock::now();
+}
+
+void FrameProfiler::endFrame() {
+    if (gpuOpen >= 0)
+        end(gpuOpen);
+    std::chrono::duration<float, std::milli> ms = Clock::now() - frameStart;
+    history[frame % HISTORY][0].cpuMs = ms.count();
+}
+
+void FrameProfiler::begin(Region r) {
+    if (r <= 0 || frame < 0)
+        return;
+    int slot = (int)(frame % LATENCY);
+    if (gpuTiming && gpuOpen < 0 && !issued[slot][r]) {
+        glBeginQuery(GL_TIME_ELAPSED, queries[slot][r]);
+        issued[slot][r] = true;
+        gpuOpen = r;
+    }
+    cpuStart[r] = Clock::now();
+}
+
+void FrameProfiler::end(Region r) {
+    if (r <= 0 || frame < 0)
+        return;
+    std::chrono::duration<float, std::milli> ms = Clock::now() - cpuStart[r];
+    Sample &s = history[frame % HISTORY][r];
+    s.cpuMs = (s.cpuMs < 0.0f ? 0.0f : s.cpuMs) + ms.count();
+    if (gpuOpen == r) {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuOpen = -1;
+    }
+}
+
+void FrameProfiler::record(Region r, float cpuMs) {
+    if (r <= 0 || frame < 0)
+        return;
+    Sample &s = history[frame % HISTORY][r];
+    s.cpuMs = (s.cpuMs < 0.0f ? 0.0f : s.cpuMs) + cpuMs;
+}
+
+void FrameProfiler::count(Counter c, float value) {
+    if (c < 0 || frame < 0)
+        return;
+    counts[frame % HISTORY][c] = value;
+}
+
+static void percentiles(std::vector<float> &values, float out[3]) {
+    out[0] = out[1] = out[2] = 0.0f;
+    if (values.empty())
+        return;
+    std::sort(values.begin(), values.end());
+    const float p[3] = { 0.50f, 0.95f, 0.99f };
+    for (int i = 0; i < 3; i++)
+        out[i] = values[(size_t)(p[i] * (values.size() - 1) + 0.5f)];
+}
+
+void FrameProfiler::report(std::ostream &out) const {
+    long long first = frame - HISTORY + 1;
+    if (first < 0)
+        first = 0;
+
+    out << std::fixed << std::setprecision(3);
+    out << std::setw(16) << "region"
+        << std::setw(10) << "cpu p50" << std::setw(10) << "p95" << std::setw(10) << "p99"
+        << std::setw(10) << "gpu p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::endl;
+
+    float frameCpu[3] = {}, frameGpu[3] = {};
+    std::vector<float> cpu, gpu;
+    for (int r = 0; r < regionCount; r++) {
+        cpu.clear();
+        gpu.clear();
+        for (long long f = first; f <= frame; f++) {
+            const Sample &s = history[f % HISTORY][r];
+            if (s.cpuMs >= 0.0f) cpu.push_back(s.cpuMs);
+            if (s.gpuMs >= 0.0f) gpu.push_back(s.gpuMs);
+        }
+        float c[3], g[3];
+        percentiles(cpu, c);
+        percentiles(gpu, g);
+        if (r == 0) {
+            memcpy(frameCpu, c, sizeof(c));
+            memcpy(frameGpu, g, sizeof(g));
+        }
+        out << std::setw(16) << names[r]
+            << std::setw(10) << c[0] << std::setw(10) << c[1] << std::setw(10) << c[2];
+        if (gpu.empty())
+            out << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(10) << "-";
+        else
+            out << std::setw(10) << g[0] << std::setw(10) << g[1] << std::setw(10) << g[2];
+        out << std::endl;
+    }
+    if (counterCount > 0) {
+        out << std::setprecision(0);
+        out << std::setw(16) << "counter"
+            << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::endl;
+        std::vector<float> values;
+        for (int c = 0; c < counterCount; c++) {
+            values.clear();
+            for (long long f = first; f <= frame; f++)
+                if (counts[f % HISTORY][c] >= 0.0f)
+                    values.push_back(counts[f % HISTORY][c]);
+            float v[3];
+            percentiles(values, v);
+            out << std::setw(16) << counterNames[c]
+                << std::setw(10) << v[0] << std::setw(10) << v[1] << std::setw(10) << v[2] << std::endl;
+        }
+        out << std::setprecision(3);
+    }
+    if (gpuTiming)
+        out << "frames are mostly " << (frameGpu[0] > frameCpu[0] ? "GPU" : "CPU") << " bound" << std::endl;
+}
+
+bool FrameProfiler::writeCsv(const char *path) const {
+    std::ofstream file(path);
+    if (!file) {
+        std::cout << "ERROR::PROFILER::CSV_NOT_WRITTEN " << path << std::endl;
+        return false;
+    }
+    long long first = frame - HISTORY + 1;
+    if (first < 0)
+        first = 0;
+
+    file << "frame,region,cpu_ms,gpu_ms,count\n";
+    for (long long f = first; f <= frame; f++) {
+        for (int r = 0; r < regionCount; r++) {
+            const Sample &s = history[f % HISTORY][r];
+            if (s.cpuMs < 0.0f)
+                continue;
+            file << f << ',' << names[r] << ',' << s.cpuMs << ',';
+            if (s.gpuMs >= 0.0f)
+                file << s.gpuMs;
+            file << ",\n";
+        }
+        for (int c = 0; c < counterCount; c++) {
+            float value = counts[f % HISTORY][c];
+            if (value >= 0.0f)
+                file << f << ',' << counterNames[c] << ",,," << value << '\n';
+        }
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <ostream>
+#include <string>
+
+/*
+Per frame CPU and GPU timing of named regions.
+
+CPU time comes from std::chrono::steady_clock. GPU time comes from
+GL_TIME_ELAPSED queries, one per region per frame, kept in a ring of
+LATENCY sets. A frame's results are only read when its set comes round
+again, LATENCY - 1 frames later, and only if GL says they're available,
+so reading them never makes the CPU wait for the GPU.
+
+Counters are per frame numbers that aren't times (objects drawn,
+culled), reported and written the same way.
+
+GL_TIME_ELAPSED queries can't be nested. A region started while another
+one is open gets CPU time only, same for a region used a second time in
+one frame (its CPU time adds up, the GPU time is the first use).
+
+Usage:
+    FrameProfiler::Region draw = profiler.region("draw");
+    FrameProfiler::Counter visible = profiler.counter("visible");
+    profiler.beginFrame();
+    profiler.begin(draw); ... profiler.end(draw);
+    profiler.count(visible, n);
+    profiler.endFrame();
+*/
+class FrameProfiler {
+public:
+    typedef int Region;
+    typedef int Counter;
+
+    static const int MAX_REGIONS = 32;
+    static const int MAX_COUNTERS = 8;
+    static const int HISTORY = 1024;  // frames kept for stats and CSV
+    static const int LATENCY = 3;     // query sets in flight
+
+    // Needs a current GL context.
+    FrameProfiler();
+    ~FrameProfiler();
+
+    // Register a region once, keep the handle. Same name, same handle.
+    // Returns -1 when MAX_REGIONS is used up, begin/end ignore it.
+    Region region(const char *name);
+
+    void beginFrame();
+    void endFrame();
+    void begin(Region r);
+    void end(Region r);
+    // CPU time measured somewhere else, e.g. on another thread. Adds up
+    // like begin/end, no GPU time.
+    void record(Region r, float cpuMs);
+
+    // Same as region(), -1 when MAX_COUNTERS is used up.
+    Counter counter(const char *name);
+    // The counter's value for the current frame, the last call wins.
+    void count(Counter c, float value);
+
+    // p50/p95/p99 of every region and counter over the kept history.
+    void report(std::ostream &out) const;
+    // One row per frame and region or counter:
+    // frame,region,cpu_ms,gpu_ms,count. gpu_ms is empty when the result
+    // never came back, count is only set on counter rows.
+    bool writeCsv(const char *path) const;
+
+    // False when queries failed to create, only CPU time is recorded.
+    bool gpuTiming;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Sample {
+        float cpuMs; // < 0 when the region didn't run that frame
+        float gpuMs; // < 0 until the query result is read back
+    };
+
+    std::string names[MAX_REGIONS];
+    int regionCount;
+    std::string counterNames[MAX_COUNTERS];
+    int counterCount;
+
+    Sample history[HISTORY][MAX_REGIONS];
+    float counts[HISTORY][MAX_COUNTERS]; // < 0 when not counted that frame
+    long long frame;     // current frame number, -1 before the first
+    Clock::time_point cpuStart[MAX_REGIONS];
+    Clock::time_point frameStart;
+
+    unsigned int queries[LATENCY][MAX_REGIONS];
+    bool issued[LATENCY][MAX_REGIONS];
+    long long slotFrame[LATENCY];
+    Region gpuOpen;      // region owning the running query, -1 if none
+
+    void resolve(int slot);
+};
+
+// Times the enclosing block.
+class ProfileScope {
+public:
+    ProfileScope(FrameProfiler &profiler, FrameProfiler::Region r) : profiler(profiler), r(r) { profiler.begin(r); }
+    ~ProfileScope() { profiler.end(r); }
+private:
+    FrameProfiler &profiler;
+    FrameProfiler::Region r;
+};
+
+#endif
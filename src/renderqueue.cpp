@@ -0,0 +1,160 @@
+#include "renderqueue.h"
+#include "glstate.h"
+
+#include <string.h>
+
+DrawPacket::DrawPacket() {
+    key = 0;
+    shader = NULL;
+    vao = 0;
+    texture = 0;
+    mode = GL_TRIANGLES;
+    count = 0;
+    indexType = GL_UNSIGNED_INT;
+    indexOffset = 0;
+    baseVertex = 0;
+    instanceCount = 1;
+    material = 0;
+    materialOffset = 0;
+    model = NULL;
+    color[0] = color[1] = color[2] = color[3] = 1.0f;
+    custom = NULL;
+    user = NULL;
+}
+
+uint64_t RenderQueue::makeKey(unsigned int layer, bool translucent, unsigned int shader,
+                              unsigned int vao, unsigned int texture, float depth) {
+    if (depth < 0.0f) depth = 0.0f;
+    if (depth > 1.0f) depth = 1.0f;
+    const uint64_t DEPTH_MAX = (1u << 23) - 1;
+    uint64_t d = (uint64_t)(depth * DEPTH_MAX);
+
+    uint64_t key = (uint64_t)(layer & 0xF) << 60;
+    if (!translucent) {
+        key |= (uint64_t)(shader & 0xFFF) << 47;
+        key |= (uint64_t)(vao & 0xFFF) << 35;
+        key |= (uint64_t)(texture & 0xFFF) << 23;
+        key |= d;
+    } else {
+        key |= (uint64_t)1 << 59;
+        key |= (DEPTH_MAX - d) << 36;
+        key |= (uint64_t)(shader & 0xFFF) << 24;
+        key |= (uint64_t)(vao & 0xFFF) << 12;
+        key |= (uint64_t)(texture & 0xFFF);
+    }
+    return key;
+}
+
+void RenderQueue::submit(const DrawPacket &packet) {
+    packets.push_back(packet);
+}
+
+void RenderQueue::clear() {
+    packets.clear();
+}
+
+void RenderQueue::sort() {
+    size_t n = packets.size();
+    items.resize(n);
+    scratch.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        items[i].key = packets[i].key;
+        items[i].index = (uint32_t)i;
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256];
+        memset(counts, 0, sizeof(counts));
+        for (size_t i = 0; i < n; i++)
+            counts[(items[i].key >> shift) & 0xFF]++;
+        // All in one bucket, this byte doesn't change the order.
+        if (n == 0 || counts[(items[0].key >> shift) & 0xFF] == n)
+            continue;
+
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; i++)
+            scratch[counts[(items[i].key >> shift) & 0xFF]++] = items[i];
+        items.swap(scratch);
+    }
+}
+
+void RenderQueue::execute() {
+    memset(&stats, 0, sizeof(stats));
+    sort();
+
+    static const float IDENTITY[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    Shader *shader = NULL;
+    unsigned int vao = 0xFFFFFFFFu;
+    unsigned int texture = 0xFFFFFFFFu;
+    unsigned int material = 0;
+    size_t materialOffset = 0;
+    objectOffsets.resize(items.size());
+    size_t next = 0;
+    while (next < items.size()) {
+        // Object blocks for as many packets as fit, one upload for all.
+        objects.reset();
+        size_t end = next;
+        for (; end < items.size(); end++) {
+            const DrawPacket &p = packets[items[end].index];
+            ObjectUniforms block;
+            memcpy(block.model, p.model ? p.model : IDENTITY, sizeof(block.model));
+            memcpy(block.color, p.color, sizeof(block.color));
+            block.uvRect[0] = block.uvRect[1] = 0.0f;
+            block.uvRect[2] = block.uvRect[3] = 1.0f;
+            if (!objects.push(&block, sizeof(block), objectOffsets[end]))
+                break;
+        }
+        if (end == next)
+            break; // a block bigger than the whole stream
+        objects.upload();
+        stats.uniformUploads++;
+
+        for (size_t i = next; i < end; i++) {
+            const DrawPacket &p = packets[items[i].index];
+            if (p.shader != shader) {
+                shader = p.shader;
+                shader->use();
+                stats.programChanges++;
+            }
+            if (p.texture != texture) {
+                texture = p.texture;
+                GLState::bindTexture(0, GL_TEXTURE_2D, texture);
+                stats.textureChanges++;
+            }
+            if (p.material && (p.material != material || p.materialOffset != materialOffset)) {
+                material = p.material;
+                materialOffset = p.materialOffset;
+                GLState::bindBufferRange(GL_UNIFORM_BUFFER, UBO_MATERIAL, material, materialOffset,
+                                         sizeof(MaterialUniforms));
+                stats.materialChanges++;
+            }
+            objects.bind(UBO_OBJECT, objectOffsets[i], sizeof(ObjectUniforms));
+
+            if (p.custom) {
+                p.custom(p.user);
+                // It binds what it likes.
+                vao = 0xFFFFFFFFu;
+                stats.draws++;
+                continue;
+            }
+            if (p.vao != vao) {
+                vao = p.vao;
+                GLState::bindVertexArray(vao);
+                stats.vaoChanges++;
+            }
+            if (p.instanceCount > 1)
+                glDrawElementsInstancedBaseVertex(p.mode, p.count, p.indexType, (void*)p.indexOffset, p.instanceCount, p.baseVertex);
+            else
+                glDrawElementsBaseVertex(p.mode, p.count, p.indexType, (void*)p.indexOffset, p.baseVertex);
+            stats.draws++;
+        }
+        next = end;
+    }
+    objects.endFrame();
+    clear();
+}
@@ -0,0 +1,102 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "shader.h"
+#include "uniforms.h"
+
+// Everything needed to issue one draw. Filled in by game code, executed
+// later by RenderQueue in sort key order.
+struct DrawPacket {
+    uint64_t key;            // see RenderQueue::makeKey()
+    Shader *shader;
+    unsigned int vao;
+    unsigned int texture;    // GL_TEXTURE_2D on unit 0, 0 for none
+    GLenum mode;
+    GLsizei count;           // index count
+    GLenum indexType;
+    size_t indexOffset;      // bytes into the VAO's element buffer
+    GLint baseVertex;
+    GLsizei instanceCount;   // 1 for a plain draw
+    unsigned int material;   // Material block buffer, 0 leaves it as is
+    size_t materialOffset;   // and where the block is in it
+    const float *model;      // Object block model matrix, NULL for identity
+    float color[4];          // Object block color
+    // Custom draw: called with the shader and texture bound instead of
+    // issuing glDrawElements. For things that draw themselves, like
+    // QuadBatch.
+    void (*custom)(void *user);
+    void *user;
+
+    DrawPacket();
+};
+
+/*
+Collects draw packets for a frame, sorts them by a 64 bit key and
+submits them in that order.
+
+Opaque key, high to low bits:
+    layer (4) | translucent = 0 (1) | shader (12) | vao (12) | texture (12) | depth (23)
+so inside a layer everything using the same shader is together, then
+the same VAO, then texture, and only then front to back.
+
+Translucent key:
+    layer (4) | translucent = 1 (1) | inverted depth (23) | shader (12) | vao (12) | texture (12)
+because blending needs back to front more than it needs fewer binds.
+
+Object names are folded into their bit fields, so two names can share a
+slot. That only costs a redundant bind, packets keep the real names.
+
+The sort is an LSD radix sort on the keys, 8 bits per pass, skipping
+passes where every key has the same byte. Buffers are reused across
+frames, nothing is allocated once the queue has grown to its working size.
+
+Per draw data (model, color) goes into the Object block: execute()
+writes every packet's block into a UniformStream up front, uploads them
+all at once and each draw only binds its range. See uniforms.h.
+*/
+class RenderQueue {
+public:
+    // depth is 0 (near) to 1 (far), clamped.
+    static uint64_t makeKey(unsigned int layer, bool translucent, unsigned int shader,
+                            unsigned int vao, unsigned int texture, float depth);
+
+    void submit(const DrawPacket &packet);
+    // Sort and issue everything, then clear for the next frame.
+    void execute();
+    void clear();
+    size_t size() const { return packets.size(); }
+
+    struct Stats {
+        unsigned int draws;
+        unsigned int programChanges;
+        unsigned int vaoChanges;
+        unsigned int textureChanges;
+        unsigned int materialChanges;
+        unsigned int uniformUploads; // Object block batches
+    };
+    // Counts for the last execute().
+    Stats stats;
+    // Object block ring, since creation.
+    const UploadRing::Stats &uploadStats() const { return objects.uploadStats(); }
+
+private:
+    struct SortItem {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<DrawPacket> packets;
+    std::vector<SortItem> items, scratch;
+    std::vector<size_t> objectOffsets; // per sorted item
+    UniformStream objects;
+
+    void sort();
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "spscring.h"
+
+/*
+Runs frame submission on its own thread, the one that owns the GL
+context, so the game thread can simulate and record frame N+1 while
+frame N is being drawn.
+
+Frame is whatever the game records per frame, it must not hold GL
+calls, only data. There are maxFramesInFlight of them. The game thread
+takes a free one with acquire(), fills it and hands it over with
+submit(). Once drawn, it comes back through a second ring. When all of
+them are queued or being drawn, acquire() waits, which caps how far the
+game can run ahead of the display (frame latency).
+
+Both directions are SpscRing, no locks. Waiting spins briefly, then
+yields, then sleeps in short steps.
+
+attach() runs first on the render thread (make the context current
+there), detach() last (release it so the main thread can take it back).
+The destructor draws whatever was already submitted, then joins.
+*/
+template <typename Frame>
+class RenderThread {
+public:
+    typedef void (*Execute)(Frame &frame, void *user);
+    typedef void (*Hook)(void *user);
+
+    RenderThread(unsigned int maxFramesInFlight, Execute execute, Hook attach, Hook detach, void *user)
+        : frames(maxFramesInFlight ? maxFramesInFlight : 1), toRender(frames.size()), toGame(frames.size()) {
+        this->execute = execute;
+        this->attach = attach;
+        this->detach = detach;
+        this->user = user;
+        stopping = false;
+        latencyWaits = 0;
+        for (Frame &f : frames)
+            toGame.push(&f);
+        thread = std::thread(&RenderThread::run, this);
+    }
+
+    ~RenderThread() {
+        stopping = true;
+        thread.join();
+    }
+
+    // Game thread. Blocks while every frame is in flight.
+    Frame *acquire() {
+        Frame *frame;
+        int spins = 0;
+        if (toGame.pop(frame))
+            return frame;
+        latencyWaits++;
+        while (!toGame.pop(frame))
+            backoff(spins);
+        return frame;
+    }
+
+    // Game thread. Never blocks, there are only as many frames as slots.
+    void submit(Frame *frame) {
+        toRender.push(frame);
+    }
+
+    // Times acquire() had to wait for the render thread.
+    long long latencyWaits;
+
+private:
+    std::vector<Frame> frames;
+    SpscRing<Frame*> toRender; // game -> render
+    SpscRing<Frame*> toGame;   // render -> game, free frames
+    std::thread thread;
+    std::atomic<bool> stopping;
+    Execute execute;
+    Hook attach, detach;
+    void *user;
+
+    static void backoff(int &spins) {
+        spins++;
+        if (spins < 64)
+            continueSpinning();
+        else if (spins < 128)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    static void continueSpinning() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    void run() {
+        if (attach)
+            attach(user);
+        Frame *frame;
+        int spins = 0;
+        for (;;) {
+            if (toRender.pop(frame)) {
+                execute(*frame, user);
+                toGame.push(frame);
+                spins = 0;
+            } else if (stopping) {
+                // Something may have come in just before stopping was set.
+                while (toRender.pop(frame)) {
+                    execute(*frame, user);
+                    toGame.push(frame);
+                }
+                break;
+            } else {
+                backoff(spins);
+            }
+        }
+        if (detach)
+            detach(user);
+    }
+};
+
+#endif
@@ -1,47 +1,111 @@
 #include "shader.h"
+#include "glad_ext.h"
+#include "glstate.h"
+#include "uniforms.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+std::string Shader::binaryCacheDir = "build/shadercache";
 
 Shader::Shader(const char* vertexPath, const char* fragmentPath) {
+    this->ID = 0;
+    this->pendingID = 0;
+
     std::string vertexCode;
     std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
+    if (preprocess(vertexPath, vertexCode) && preprocess(fragmentPath, fragmentCode))
+        build(vertexCode, fragmentCode);
+}
+
+Shader::Shader() {
+    this->ID = 0;
+    this->pendingID = 0;
+}
+
+bool Shader::preprocess(const std::string &path, std::string &out, int depth) {
+    // Deep enough for real use, stops include cycles.
+    if (depth > 16) {
+        std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP " << path << std::endl;
+        return false;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        return false;
+    }
+    std::stringstream source;
+    source << file.rdbuf();
 
-    vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+    std::string dir;
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos)
+        dir = path.substr(0, slash + 1);
 
-    try {
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+    std::string line;
+    while (std::getline(source, line)) {
+        size_t start = line.find_first_not_of(" \t");
+        if (start != std::string::npos && line.compare(start, 8, "#include") == 0) {
+            size_t open = line.find('"', start);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos) {
+                std::cout << "ERROR::SHADER::BAD_INCLUDE " << path << ": " << line << std::endl;
+                return false;
+            }
+            if (!preprocess(dir + line.substr(open + 1, close - open - 1), out, depth + 1))
+                return false;
+            continue;
+        }
+        out += line;
+        out += '\n';
     }
-    catch(std::ifstream::failure e) {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    return true;
+}
+
+bool Shader::build(const std::string &vertexCode, const std::string &fragmentCode) {
+    if (this->ID)
+        GLState::deleteProgram(this->ID);
+    this->ID = 0;
+
+    bool linked = loadBinary(vertexCode, fragmentCode);
+    if (!linked) {
+        linked = compile(vertexCode.c_str(), fragmentCode.c_str());
+        if (linked)
+            saveBinary(vertexCode, fragmentCode);
     }
 
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
+    if (linked)
+        cacheUniforms();
+    return linked;
+}
 
+bool Shader::compile(const char* vShaderCode, const char* fShaderCode) {
+    unsigned int program = startProgram(vShaderCode, fShaderCode);
+    if (!finishProgram(program)) {
+        // ID stays 0, a half built program is no use to anyone.
+        GLState::deleteProgram(program);
+        return false;
+    }
+    this->ID = program;
+    return true;
+}
+
+// Issue the compile and link without asking for the result. Querying a
+// status is what makes the driver wait, with KHR_parallel_shader_compile
+// the work runs in the background until finishProgram().
+unsigned int Shader::startProgram(const char* vShaderCode, const char* fShaderCode) {
     // Shader program, same as one in original main.cpp
     // Shaders are small programs that run on the GPU
 
-    unsigned int vertex, fragment;
-    int success;
-    char infoLog[512];
+    unsigned int vertex, fragment, program;
 
     // Vertex Shader
     // Tranform Vertices
     vertex = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertex, 1, &vShaderCode, NULL);
     glCompileShader(vertex);
-    glad_glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    };
 
     // Geometry Shader
     // Transform a collection of vertices, make primitive
@@ -53,42 +117,417 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath) {
     fragment = glCreateShader(GL_FRAGMENT_SHADER);
     glShaderSource(fragment, 1, &fShaderCode, NULL);
     glCompileShader(fragment);
-    glad_glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-    };
 
     // Build the shader program
 
-    this->ID = glCreateProgram();
-    glAttachShader(this->ID, vertex);
-    glAttachShader(this->ID, fragment);
-    glLinkProgram(this->ID);
+    program = glCreateProgram();
+    // Allow glGetProgramBinary later, has to be set before linking.
+    if (GLAD_GL_ARB_get_program_binary && !binaryCacheDir.empty())
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    glLinkProgram(program);
+    return program;
+}
+
+// True when the driver is done compiling and linking, never waits.
+// Without KHR_parallel_shader_compile there's no way to ask, so it's
+// always true and finishProgram() blocks instead.
+static bool programDone(unsigned int program) {
+    if (!GLAD_GL_KHR_parallel_shader_compile)
+        return true;
+    int done = 0;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+    return done;
+}
+
+// Report errors of a started program and drop its shader objects.
+bool Shader::finishProgram(unsigned int program) {
+    int success;
+    char infoLog[512];
+
+    unsigned int shaders[2];
+    GLsizei count = 0;
+    glGetAttachedShaders(program, 2, &count, shaders);
+    for (int i = 0; i < count; i++) {
+        glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &success);
+        if (!success) {
+            int type;
+            glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+            glGetShaderInfoLog(shaders[i], 512, NULL, infoLog);
+            if (type == GL_VERTEX_SHADER)
+                std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+            else
+                std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+        }
+    }
+
     // check for errors
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
-        glGetProgramInfoLog(this->ID, 512, NULL, infoLog);
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
         std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     }
 
     // memory management -
     // Shaders are linked into the program and can be deleted
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    for (int i = 0; i < count; i++) {
+        glDetachShader(program, shaders[i]);
+        glDeleteShader(shaders[i]);
+    }
+
+    return success;
+}
+
+// ==========================================================
+// ============== Hot reload ================================
+// ==========================================================
+
+void Shader::beginReload(const std::string &vertexCode, const std::string &fragmentCode) {
+    // A newer edit replaces one still compiling.
+    if (pendingID)
+        GLState::deleteProgram(pendingID);
+    pendingID = startProgram(vertexCode.c_str(), fragmentCode.c_str());
+    pendingVertex = vertexCode;
+    pendingFragment = fragmentCode;
+}
+
+Shader::ReloadStatus Shader::pollReload() {
+    if (!pendingID)
+        return RELOAD_NONE;
+    if (!programDone(pendingID))
+        return RELOAD_PENDING;
+
+    unsigned int program = pendingID;
+    pendingID = 0;
+    if (!finishProgram(program)) {
+        // Keep running the old program, fix the shader and save again.
+        GLState::deleteProgram(program);
+        return RELOAD_FAILED;
+    }
+
+    // Swap only now that the new one is known good.
+    if (this->ID)
+        GLState::deleteProgram(this->ID);
+    this->ID = program;
+    cacheUniforms();
+    saveBinary(pendingVertex, pendingFragment);
+    pendingVertex.clear();
+    pendingFragment.clear();
+    return RELOAD_SWAPPED;
+}
+
+// ==========================================================
+// ============== Program binary cache ======================
+// ==========================================================
+
+/*
+Linked programs are saved with glGetProgramBinary and loaded back with
+glProgramBinary on the next launch, which skips the GLSL compiler
+entirely. The file name is a hash of both sources and the driver strings,
+so editing a shader or updating the driver just misses the cache. The
+driver can still reject a binary (its own version check), in that case
+the file is dropped and the shader is compiled from source.
+*/
+
+struct BinaryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+};
+
+static const uint32_t BINARY_MAGIC = 0x43424853; // "SHBC"
+static const uint32_t BINARY_VERSION = 1;
+
+// FNV-1a, 64 bit. Not cryptographic, only has to spot changes.
+static uint64_t hashBytes(uint64_t h, const void *data, size_t size) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t hashString(uint64_t h, const char *s) {
+    // Include the terminator so "ab"+"c" and "a"+"bc" differ.
+    return hashBytes(h, s ? s : "", s ? strlen(s) + 1 : 1);
+}
+
+static uint64_t binaryKey(const std::string &vertexCode, const std::string &fragmentCode) {
+    uint64_t h = 14695981039346656037ULL;
+    h = hashString(h, (const char *)glGetString(GL_VENDOR));
+    h = hashString(h, (const char *)glGetString(GL_RENDERER));
+    h = hashString(h, (const char *)glGetString(GL_VERSION));
+    h = hashString(h, vertexCode.c_str());
+    h = hashString(h, fragmentCode.c_str());
+    return h;
+}
+
+static std::string binaryPath(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+    return Shader::binaryCacheDir + name;
+}
+
+bool Shader::loadBinary(const std::string &vertexCode, const std::string &fragmentCode) {
+    if (!GLAD_GL_ARB_get_program_binary || binaryCacheDir.empty())
+        return false;
+
+    uint64_t key = binaryKey(vertexCode, fragmentCode);
+    std::string path = binaryPath(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    BinaryHeader header;
+    if (!file.read((char *)&header, sizeof(header)) || header.magic != BINARY_MAGIC
+        || header.version != BINARY_VERSION || header.key != key) {
+        remove(path.c_str());
+        return false;
+    }
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), header.length)) {
+        remove(path.c_str());
+        return false;
+    }
+
+    this->ID = glCreateProgram();
+    glProgramBinary(this->ID, header.format, binary.data(), header.length);
+    int success;
+    glGetProgramiv(this->ID, GL_LINK_STATUS, &success);
+    if (!success) {
+        // Stale for this driver, rebuild it from source.
+        GLState::deleteProgram(this->ID);
+        this->ID = 0;
+        remove(path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void Shader::saveBinary(const std::string &vertexCode, const std::string &fragmentCode) {
+    if (!GLAD_GL_ARB_get_program_binary || binaryCacheDir.empty())
+        return;
+
+    int length = 0;
+    glGetProgramiv(this->ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    BinaryHeader header;
+    header.magic = BINARY_MAGIC;
+    header.version = BINARY_VERSION;
+    header.key = binaryKey(vertexCode, fragmentCode);
+    header.length = 0;
+    std::vector<char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(this->ID, length, &written, &format, binary.data());
+    if (written <= 0)
+        return;
+    header.format = format;
+    header.length = (uint32_t)written;
+
+    // Write to a temporary name first, a crash mid-write must not leave
+    // a truncated file under the real name.
+    mkdir(binaryCacheDir.c_str(), 0755);
+    std::string path = binaryPath(header.key);
+    std::string tmpPath = path + ".tmp";
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    file.write((const char *)&header, sizeof(header));
+    file.write(binary.data(), written);
+    file.close();
+    if (!file) {
+        std::cout << "ERROR::SHADER::BINARY_CACHE_WRITE_FAILED " << tmpPath << std::endl;
+        remove(tmpPath.c_str());
+        return;
+    }
+    rename(tmpPath.c_str(), path.c_str());
+}
+
+// Ask the linked program for its active uniforms once, so nothing in the
+// render loop has to call glGetUniformLocation.
+//
+// Handles stay valid when the program is replaced (hot reload): names
+// already known keep their slot, new ones are added at the end, and
+// slots whose uniform went away get location -1 and are skipped.
+void Shader::cacheUniforms() {
+    for (UniformSlot &s : this->uniforms) {
+        s.location = -1;
+        s.valid = false;
+        s.warned = false;
+    }
+
+    int count = 0;
+    int maxLength = 0;
+    glGetProgramiv(this->ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+    for (int i = 0; i < count; i++) {
+        int length = 0;
+        int size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(this->ID, i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), length);
+
+        // Uniforms in blocks have no location, they're set through buffers.
+        int location = glGetUniformLocation(this->ID, name.c_str());
+        if (location < 0)
+            continue;
+
+        Uniform u = uniform(name);
+        if (u < 0) {
+            u = (Uniform)this->uniforms.size();
+            this->uniforms.push_back(UniformSlot());
+            uniformIndex[name] = u;
+            // Arrays are reported as "name[0]", also answer to plain "name".
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+                uniformIndex[name.substr(0, name.size() - 3)] = u;
+        }
+        UniformSlot &s = this->uniforms[u];
+        s = UniformSlot();
+        s.location = location;
+        s.type = type;
+    }
+
+    // Blocks go to their fixed binding points, see uniforms.h. Done
+    // after every link, binary loads and reloads included.
+    int blocks = 0;
+    glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_BLOCKS, &blocks);
+    for (int i = 0; i < blocks; i++) {
+        char name[64];
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(this->ID, i, sizeof(name), &length, name);
+        size_t expected = 0;
+        int binding = uniformBlockBinding(name, &expected);
+        if (binding < 0) {
+            std::cout << "ERROR::SHADER::UNKNOWN_UNIFORM_BLOCK " << name << std::endl;
+            continue;
+        }
+        GLint size = 0;
+        glGetActiveUniformBlockiv(this->ID, i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        if ((size_t)size != expected)
+            std::cout << "ERROR::SHADER::UNIFORM_BLOCK_SIZE_MISMATCH " << name << ": GL says " << size
+                      << " bytes, C++ has " << expected << std::endl;
+        glUniformBlockBinding(this->ID, i, binding);
+    }
+}
+
+Shader::Uniform Shader::uniform(const std::string &name) const {
+    auto it = uniformIndex.find(name);
+    return it == uniformIndex.end() ? -1 : it->second;
+}
+
+static bool isIntType(GLenum type) {
+    switch (type) {
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_BUFFER:
+        return true;
+    default:
+        return false;
+    }
+}
+
+Shader::UniformSlot *Shader::slot(Uniform u, GLenum type) const {
+    if (u < 0 || u >= (Uniform)this->uniforms.size())
+        return NULL;
+    UniformSlot *s = &this->uniforms[u];
+    if (s->location < 0)
+        return NULL;
+    bool match = s->type == type || (type == GL_INT && isIntType(s->type));
+    if (!match) {
+        // Would be GL_INVALID_OPERATION anyway, report it once and skip.
+        if (!s->warned)
+            std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH at location " << s->location << std::endl;
+        s->warned = true;
+        return NULL;
+    }
+    return s;
+}
+
+bool Shader::changed(UniformSlot *s, const void *data, size_t bytes) const {
+    if (s->valid && memcmp(s->value, data, bytes) == 0)
+        return false;
+    memcpy(s->value, data, bytes);
+    s->valid = true;
+    return true;
 }
 
 void Shader::use() {
-    glUseProgram(this->ID);
+    GLState::useProgram(this->ID);
+}
+
+void Shader::setBool(Uniform u, bool value) const {
+    UniformSlot *s = slot(u, GL_INT);
+    int v = (int)value;
+    if (s && changed(s, &v, sizeof(v)))
+        glUniform1i(s->location, v);
+}
+
+void Shader::setInt(Uniform u, int value) const {
+    UniformSlot *s = slot(u, GL_INT);
+    if (s && changed(s, &value, sizeof(value)))
+        glUniform1i(s->location, value);
+}
+
+void Shader::setFloat(Uniform u, float value) const {
+    UniformSlot *s = slot(u, GL_FLOAT);
+    if (s && changed(s, &value, sizeof(value)))
+        glUniform1f(s->location, value);
+}
+
+void Shader::setVec2(Uniform u, float x, float y) const {
+    UniformSlot *s = slot(u, GL_FLOAT_VEC2);
+    float v[2] = {x, y};
+    if (s && changed(s, v, sizeof(v)))
+        glUniform2fv(s->location, 1, v);
+}
+
+void Shader::setVec3(Uniform u, float x, float y, float z) const {
+    UniformSlot *s = slot(u, GL_FLOAT_VEC3);
+    float v[3] = {x, y, z};
+    if (s && changed(s, v, sizeof(v)))
+        glUniform3fv(s->location, 1, v);
+}
+
+void Shader::setVec4(Uniform u, float x, float y, float z, float w) const {
+    UniformSlot *s = slot(u, GL_FLOAT_VEC4);
+    float v[4] = {x, y, z, w};
+    if (s && changed(s, v, sizeof(v)))
+        glUniform4fv(s->location, 1, v);
+}
+
+void Shader::setMat3(Uniform u, const float *m) const {
+    UniformSlot *s = slot(u, GL_FLOAT_MAT3);
+    if (s && changed(s, m, 9 * sizeof(float)))
+        glUniformMatrix3fv(s->location, 1, GL_FALSE, m);
+}
+
+void Shader::setMat4(Uniform u, const float *m) const {
+    UniformSlot *s = slot(u, GL_FLOAT_MAT4);
+    if (s && changed(s, m, 16 * sizeof(float)))
+        glUniformMatrix4fv(s->location, 1, GL_FALSE, m);
 }
 
 void Shader::setBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(this->ID, name.c_str()), (int)value);
+    setBool(uniform(name), value);
 }
 
 void Shader::setInt(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(this->ID, name.c_str()), value);
+    setInt(uniform(name), value);
 }
 
 void Shader::setFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(this->ID, name.c_str()), value);
+    setFloat(uniform(name), value);
 }
@@ -7,18 +7,92 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 class Shader {
 public:
     unsigned int ID;
-    // Constructor, read files and build shader.
+
+    // Handle to a uniform cached after link. Look it up once with
+    // uniform() and keep it, setters taking a handle do no string work
+    // and no glGetUniformLocation. -1 means "not an active uniform",
+    // setters silently ignore it (same as GL does for location -1).
+    typedef int Uniform;
+
+    // Where linked program binaries are kept between runs, see shader.cpp.
+    // Empty disables the cache. Only used if the driver has
+    // GL_ARB_get_program_binary.
+    static std::string binaryCacheDir;
+
+    // Constructor, read files (through preprocess()) and build shader.
+    // Blocks on the file reads, use AssetLoader::loadShader() for
+    // anything that isn't startup.
     Shader(const char* vertexPath, const char* fragmentPath);
+    // Empty, ID is 0 until build() succeeds.
+    Shader();
+    // Compile and link from source already in memory (or load the
+    // cached binary). Returns false if it didn't link.
+    bool build(const std::string &vertexCode, const std::string &fragmentCode);
     // use the shader program
     void use();
 
+    Uniform uniform(const std::string &name) const;
+
+    // Read a shader source and expand #include "file" lines, relative
+    // to the including file. No GL, safe on any thread.
+    static bool preprocess(const std::string &path, std::string &out, int depth = 0);
+
+    // Hot reload. beginReload() starts building a replacement program
+    // and returns right away, pollReload() checks on it once per frame.
+    // ID is swapped only after a successful link, a broken edit leaves
+    // the old program running. Uniform handles stay valid across swaps.
+    enum ReloadStatus { RELOAD_NONE, RELOAD_PENDING, RELOAD_SWAPPED, RELOAD_FAILED };
+    void beginReload(const std::string &vertexCode, const std::string &fragmentCode);
+    ReloadStatus pollReload();
+
+    // Setters skip the glUniform* call when the value is the same as the
+    // last one sent. The program has to be bound with use() first.
+    void setBool(Uniform u, bool value) const;
+    void setInt(Uniform u, int value) const;
+    void setFloat(Uniform u, float value) const;
+    void setVec2(Uniform u, float x, float y) const;
+    void setVec3(Uniform u, float x, float y, float z) const;
+    void setVec4(Uniform u, float x, float y, float z, float w) const;
+    // Matrices are column major, 9 or 16 floats.
+    void setMat3(Uniform u, const float *m) const;
+    void setMat4(Uniform u, const float *m) const;
+
+    // By name, does a hash lookup. Fine for setup code, use handles in loops.
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
     void setFloat(const std::string &name, float value) const;
+
+private:
+    struct UniformSlot {
+        int location;
+        GLenum type;
+        bool valid;      // value holds what the program currently has
+        bool warned;     // type mismatch already reported
+        float value[16]; // shadow copy, ints are stored bitwise
+    };
+
+    // Shadow values change in const setters, the program is still the same.
+    mutable std::vector<UniformSlot> uniforms;
+    std::unordered_map<std::string, Uniform> uniformIndex;
+
+    // replacement program being built by beginReload(), 0 if none
+    unsigned int pendingID;
+    std::string pendingVertex, pendingFragment;
+
+    bool compile(const char* vShaderCode, const char* fShaderCode);
+    static unsigned int startProgram(const char* vShaderCode, const char* fShaderCode);
+    static bool finishProgram(unsigned int program);
+    bool loadBinary(const std::string &vertexCode, const std::string &fragmentCode);
+    void saveBinary(const std::string &vertexCode, const std::string &fragmentCode);
+    void cacheUniforms();
+    UniformSlot *slot(Uniform u, GLenum type) const;
+    bool changed(UniformSlot *s, const void *data, size_t bytes) const;
 };
 
 #endif
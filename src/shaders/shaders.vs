@@ -1,8 +1,13 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aColor;
+layout (location = 2) in vec2 aTexCoord;
 out vec4 vertexColor;
+out vec2 texCoord;
+#include "uniforms.glsl"
 void main()
 {
-   gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);
-   vertexColor = vec4(0.5f, 0.0f, 0.0f, 1.0f);
+   gl_Position = viewProjection * vec4(aPos, 1.0);
+   vertexColor = aColor;
+   texCoord = aTexCoord;
 }
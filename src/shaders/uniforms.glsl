@@ -0,0 +1,30 @@
+// Uniform blocks shared by all programs, mirrored by the structs in
+// uniforms.h (std140, keep both in step). Binding points are set by
+// Shader after linking, GLSL 330 can't say them here.
+
+layout (std140) uniform Frame
+{
+   mat4 viewProjection;
+   vec4 frameTime;     // seconds, pulse (0..1), frame delta, unused
+   vec4 viewport;      // width, height, 1 / width, 1 / height
+};
+
+layout (std140) uniform Material
+{
+   vec4 materialTint;
+   vec4 materialParams; // alpha cutoff, unused x3
+};
+
+layout (std140) uniform Object
+{
+   mat4 objectModel;
+   vec4 objectColor;
+   vec4 objectUVRect;  // u, v offset then width, height
+};
+
+layout (std140) uniform Mesh
+{
+   vec4 meshPositionScale;  // xyz, w = 1 for octahedral normals
+   vec4 meshPositionOffset;
+   vec4 meshUVTransform;    // offset u v, then scale u v
+};
@@ -0,0 +1,345 @@
+#include "spatial.h"
+
+#include <math.h>
+
+static AABB combine(const AABB &a, const AABB &b) {
+    AABB r;
+    r.min.x = fminf(a.min.x, b.min.x); r.min.y = fminf(a.min.y, b.min.y); r.min.z = fminf(a.min.z, b.min.z);
+    r.max.x = fmaxf(a.max.x, b.max.x); r.max.y = fmaxf(a.max.y, b.max.y); r.max.z = fmaxf(a.max.z, b.max.z);
+    return r;
+}
+
+// Half the surface area, plus the edges so flat boxes still compare.
+static float cost(const AABB &a) {
+    float x = a.max.x - a.min.x, y = a.max.y - a.min.y, z = a.max.z - a.min.z;
+    return x * y + y * z + z * x + (x + y + z) * 1.0e-3f;
+}
+
+static int maxInt(int a, int b) { return a > b ? a : b; }
+
+// Frustum -------------------------------------------------------------------
+
+Frustum Frustum::fromMatrix(const mat4 &viewProjection) {
+    // Gribb/Hartmann: plane = row 3 +- row i. Not normalized, both sides
+    // of the test scale the same.
+    const float *m = viewProjection.m;
+    float rows[4][4];
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            rows[r][c] = m[c * 4 + r];
+
+    Frustum f;
+    for (int p = 0; p < 6; p++) {
+        const float *axis = rows[p / 2];
+        float sign = (p & 1) ? -1.0f : 1.0f;
+        f.nx[p] = rows[3][0] + sign * axis[0];
+        f.ny[p] = rows[3][1] + sign * axis[1];
+        f.nz[p] = rows[3][2] + sign * axis[2];
+        f.d[p] = rows[3][3] + sign * axis[3];
+    }
+    for (int p = 6; p < 8; p++) {
+        f.nx[p] = f.nx[p - 6];
+        f.ny[p] = f.ny[p - 6];
+        f.nz[p] = f.nz[p - 6];
+        f.d[p] = f.d[p - 6];
+    }
+    return f;
+}
+
+// Center/extent test: distance of the center to each plane against the
+// box's projected radius on that plane's normal.
+Frustum::Result Frustum::classify(const AABB &box) const {
+    float cx = (box.min.x + box.max.x) * 0.5f, ex = (box.max.x - box.min.x) * 0.5f;
+    float cy = (box.min.y + box.max.y) * 0.5f, ey = (box.max.y - box.min.y) * 0.5f;
+    float cz = (box.min.z + box.max.z) * 0.5f, ez = (box.max.z - box.min.z) * 0.5f;
+#if defined(VECMATH_SSE)
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy), vcz = _mm_set1_ps(cz);
+    __m128 vex = _mm_set1_ps(ex), vey = _mm_set1_ps(ey), vez = _mm_set1_ps(ez);
+    int outside = 0, crossing = 0;
+    for (int i = 0; i < 8; i += 4) {
+        __m128 x = _mm_load_ps(nx + i), y = _mm_load_ps(ny + i), z = _mm_load_ps(nz + i);
+        __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, vcx), _mm_mul_ps(y, vcy)),
+                                 _mm_add_ps(_mm_mul_ps(z, vcz), _mm_load_ps(d + i)));
+        __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, x), vex),
+                                              _mm_mul_ps(_mm_andnot_ps(signMask, y), vey)),
+                                   _mm_mul_ps(_mm_andnot_ps(signMask, z), vez));
+        outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+        crossing |= _mm_movemask_ps(_mm_cmplt_ps(dist, radius));
+    }
+    if (outside)
+        return OUTSIDE;
+    return crossing ? INTERSECTS : INSIDE;
+#else
+    bool crossing = false;
+    for (int p = 0; p < 6; p++) {
+        float dist = nx[p] * cx + ny[p] * cy + nz[p] * cz + d[p];
+        float radius = fabsf(nx[p]) * ex + fabsf(ny[p]) * ey + fabsf(nz[p]) * ez;
+        if (dist + radius < 0.0f)
+            return OUTSIDE;
+        if (dist < radius)
+            crossing = true;
+    }
+    return crossing ? INTERSECTS : INSIDE;
+#endif
+}
+
+// AabbTree ------------------------------------------------------------------
+
+AabbTree::AabbTree(float margin) {
+    root = NULL_PROXY;
+    freeList = NULL_PROXY;
+    leaves = 0;
+    this->margin = margin;
+}
+
+int AabbTree::allocate() {
+    if (freeList == NULL_PROXY) {
+        nodes.push_back(Node());
+        nodes.back().height = -1;
+        nodes.back().parent = NULL_PROXY;
+        freeList = (int)nodes.size() - 1;
+    }
+    int node = freeList;
+    freeList = nodes[node].parent;
+    nodes[node].parent = NULL_PROXY;
+    nodes[node].child1 = NULL_PROXY;
+    nodes[node].child2 = NULL_PROXY;
+    nodes[node].height = 0;
+    nodes[node].user = 0;
+    return node;
+}
+
+void AabbTree::release(int node) {
+    nodes[node].parent = freeList;
+    nodes[node].height = -1;
+    freeList = node;
+}
+
+void AabbTree::fatten(AABB &fat, const AABB &box, const vec3 &displacement) const {
+    vec3 grow = { margin, margin, margin };
+    fat.min = box.min - grow;
+    fat.max = box.max + grow;
+    if (displacement.x < 0.0f) fat.min.x += displacement.x; else fat.max.x += displacement.x;
+    if (displacement.y < 0.0f) fat.min.y += displacement.y; else fat.max.y += displacement.y;
+    if (displacement.z < 0.0f) fat.min.z += displacement.z; else fat.max.z += displacement.z;
+}
+
+AabbTree::Proxy AabbTree::insert(const AABB &box, uint32_t user) {
+    int leaf = allocate();
+    fatten(nodes[leaf].box, box, vec3());
+    nodes[leaf].user = user;
+    insertLeaf(leaf);
+    leaves++;
+    return leaf;
+}
+
+void AabbTree::remove(Proxy proxy) {
+    if (proxy < 0 || proxy >= (int)nodes.size() || nodes[proxy].height != 0)
+        return;
+    removeLeaf(proxy);
+    release(proxy);
+    leaves--;
+}
+
+bool AabbTree::move(Proxy proxy, const AABB &box, const vec3 &displacement) {
+    if (nodes[proxy].box.contains(box))
+        return false;
+    removeLeaf(proxy);
+    fatten(nodes[proxy].box, box, displacement);
+    insertLeaf(proxy);
+    return true;
+}
+
+void AabbTree::update(Proxy proxy, const AABB &box, const vec3 &displacement) {
+    AABB &fat = nodes[proxy].box;
+    if (fat.contains(box))
+        return;
+    fatten(fat, box, displacement);
+    for (int node = nodes[proxy].parent; node != NULL_PROXY; node = nodes[node].parent) {
+        if (nodes[node].box.contains(fat))
+            break;
+        nodes[node].box = combine(nodes[node].box, fat);
+    }
+}
+
+void AabbTree::insertLeaf(int leaf) {
+    if (root == NULL_PROXY) {
+        root = leaf;
+        nodes[leaf].parent = NULL_PROXY;
+        return;
+    }
+
+    // Walk down to the cheapest sibling. Going into a child costs the
+    // growth of every node on the way (inheritance).
+    AABB leafBox = nodes[leaf].box;
+    int index = root;
+    while (!nodes[index].isLeaf()) {
+        int child1 = nodes[index].child1;
+        int child2 = nodes[index].child2;
+        float area = cost(nodes[index].box);
+        float combinedArea = cost(combine(nodes[index].box, leafBox));
+        float here = 2.0f * combinedArea;
+        float inheritance = 2.0f * (combinedArea - area);
+
+        float cost1 = cost(combine(leafBox, nodes[child1].box)) + inheritance;
+        if (!nodes[child1].isLeaf())
+            cost1 -= cost(nodes[child1].box);
+        float cost2 = cost(combine(leafBox, nodes[child2].box)) + inheritance;
+        if (!nodes[child2].isLeaf())
+            cost2 -= cost(nodes[child2].box);
+
+        if (here < cost1 && here < cost2)
+            break;
+        index = cost1 < cost2 ? child1 : child2;
+    }
+
+    int sibling = index;
+    int oldParent = nodes[sibling].parent;
+    int newParent = allocate();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = combine(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+    if (oldParent != NULL_PROXY) {
+        if (nodes[oldParent].child1 == sibling)
+            nodes[oldParent].child1 = newParent;
+        else
+            nodes[oldParent].child2 = newParent;
+    } else {
+        root = newParent;
+    }
+
+    refitUp(nodes[leaf].parent);
+}
+
+void AabbTree::removeLeaf(int leaf) {
+    if (leaf == root) {
+        root = NULL_PROXY;
+        return;
+    }
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent != NULL_PROXY) {
+        if (nodes[grandParent].child1 == parent)
+            nodes[grandParent].child1 = sibling;
+        else
+            nodes[grandParent].child2 = sibling;
+        nodes[sibling].parent = grandParent;
+        release(parent);
+        refitUp(grandParent);
+    } else {
+        root = sibling;
+        nodes[sibling].parent = NULL_PROXY;
+        release(parent);
+    }
+}
+
+// Balance and fix up boxes and heights from node to the root.
+void AabbTree::refitUp(int node) {
+    while (node != NULL_PROXY) {
+        node = balance(node);
+        int child1 = nodes[node].child1;
+        int child2 = nodes[node].child2;
+        nodes[node].height = 1 + maxInt(nodes[child1].height, nodes[child2].height);
+        nodes[node].box = combine(nodes[child1].box, nodes[child2].box);
+        node = nodes[node].parent;
+    }
+}
+
+// If one side is more than one level taller, rotate its taller child up
+// into a's place. Returns the node now at a's position.
+int AabbTree::balance(int a) {
+    if (nodes[a].isLeaf() || nodes[a].height < 2)
+        return a;
+
+    int b = nodes[a].child1;
+    int c = nodes[a].child2;
+    int diff = nodes[c].height - nodes[b].height;
+    if (diff >= -1 && diff <= 1)
+        return a;
+
+    // up is the child moving up, keep the one staying with a
+    bool rightHeavy = diff > 1;
+    int up = rightHeavy ? c : b;
+    int stay = rightHeavy ? b : c;
+    int f = nodes[up].child1;
+    int g = nodes[up].child2;
+
+    // up takes a's place under a's parent
+    nodes[up].child1 = a;
+    nodes[up].parent = nodes[a].parent;
+    nodes[a].parent = up;
+    if (nodes[up].parent != NULL_PROXY) {
+        if (nodes[nodes[up].parent].child1 == a)
+            nodes[nodes[up].parent].child1 = up;
+        else
+            nodes[nodes[up].parent].child2 = up;
+    } else {
+        root = up;
+    }
+
+    // The taller grandchild stays with up, the other one moves to a.
+    int keep = nodes[f].height > nodes[g].height ? f : g;
+    int give = keep == f ? g : f;
+    nodes[up].child2 = keep;
+    if (rightHeavy)
+        nodes[a].child2 = give;
+    else
+        nodes[a].child1 = give;
+    nodes[give].parent = a;
+
+    nodes[a].box = combine(nodes[stay].box, nodes[give].box);
+    nodes[a].height = 1 + maxInt(nodes[stay].height, nodes[give].height);
+    nodes[up].box = combine(nodes[a].box, nodes[keep].box);
+    nodes[up].height = 1 + maxInt(nodes[a].height, nodes[keep].height);
+    return up;
+}
+
+void AabbTree::cull(const Frustum &frustum, std::vector<uint32_t> &visible, CullStats &stats) const {
+    stats.visible = 0;
+    stats.culled = 0;
+    stats.nodesTested = 0;
+    if (root == NULL_PROXY)
+        return;
+
+    // Entries are node * 2 + 1 when the node is known to be inside, no
+    // more tests needed below it.
+    size_t first = visible.size();
+    stack.clear();
+    // Depth first never holds more than height + 1 entries. Double that,
+    // so the tree getting a level or two deeper doesn't mean allocating
+    // in the middle of a frame.
+    size_t worst = (size_t)height() + 1;
+    if (stack.capacity() < worst)
+        stack.reserve(worst * 2);
+    stack.push_back(root * 2);
+    while (!stack.empty()) {
+        int entry = stack.back();
+        stack.pop_back();
+        int node = entry >> 1;
+        bool inside = entry & 1;
+        const Node &n = nodes[node];
+
+        if (!inside) {
+            stats.nodesTested++;
+            Frustum::Result r = frustum.classify(n.box);
+            if (r == Frustum::OUTSIDE)
+                continue;
+            inside = r == Frustum::INSIDE;
+        }
+        if (n.isLeaf()) {
+            visible.push_back(n.user);
+        } else {
+            stack.push_back(n.child1 * 2 + inside);
+            stack.push_back(n.child2 * 2 + inside);
+        }
+    }
+    stats.visible = (unsigned int)(visible.size() - first);
+    stats.culled = leaves - stats.visible;
+}
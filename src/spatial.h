@@ -0,0 +1,110 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "vecmath.h"
+
+struct AABB {
+    vec3 min, max;
+
+    bool contains(const AABB &b) const {
+        return min.x <= b.min.x && min.y <= b.min.y && min.z <= b.min.z
+            && max.x >= b.max.x && max.y >= b.max.y && max.z >= b.max.z;
+    }
+};
+
+/*
+The six clip planes of a view projection matrix, kept as a structure of
+arrays (all normal x, all normal y, ...) so one SSE op tests a box
+against four planes. Padded to 8 with copies, which can't change the
+answer.
+*/
+struct Frustum {
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+    alignas(16) float nx[8], ny[8], nz[8], d[8];
+
+    static Frustum fromMatrix(const mat4 &viewProjection);
+    Result classify(const AABB &box) const;
+};
+
+/*
+Dynamic bounding volume tree for culling (and later picking or
+collision).
+
+Every object is a leaf with a "fat" box, its real box grown by margin.
+Culling tests the fat boxes, so objects just outside the view can still
+come back as visible.
+move() does nothing while the real box stays inside the fat one, so
+objects that jiggle or move slowly cost one containment test per tick.
+Only when it leaves is the leaf taken out and inserted again, picking
+the sibling that grows the tree's surface area least, then rotating
+ancestors to keep the tree balanced. That keeps updates incremental,
+the tree is never rebuilt. For swarms that all move every tick there is
+update(), which only refits the boxes on the way up.
+
+cull() walks from the root: a node outside the frustum drops its whole
+subtree, a node fully inside takes its whole subtree without any more
+plane tests, only nodes crossing the frustum are opened.
+*/
+class AabbTree {
+public:
+    typedef int Proxy;
+    static const Proxy NULL_PROXY = -1;
+
+    struct CullStats {
+        unsigned int visible;
+        unsigned int culled;
+        unsigned int nodesTested;
+    };
+
+    explicit AabbTree(float margin = 0.05f);
+
+    Proxy insert(const AABB &box, uint32_t user);
+    void remove(Proxy proxy);
+    // True when the leaf had to be reinserted. displacement is how far
+    // the object is expected to go before the next few moves, the fat
+    // box is stretched that way so fast movers don't reinsert every tick.
+    bool move(Proxy proxy, const AABB &box, const vec3 &displacement = vec3());
+
+    // Cheaper move for lots of objects moving every tick: the leaf stays
+    // where it is, its ancestors only grow until one already covers it.
+    // Boxes never shrink this way, the tree gets looser as things drift
+    // apart, fine for short lived objects that get inserted fresh often.
+    void update(Proxy proxy, const AABB &box, const vec3 &displacement = vec3());
+
+    // Appends the user value of every leaf touching the frustum.
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible, CullStats &stats) const;
+
+    unsigned int leafCount() const { return leaves; }
+    int height() const { return root == NULL_PROXY ? 0 : nodes[root].height; }
+
+private:
+    struct Node {
+        AABB box;       // fat box for leaves
+        int parent;     // next free node when on the free list
+        int child1, child2;
+        int height;     // 0 for leaves, -1 when free
+        uint32_t user;
+        bool isLeaf() const { return child1 == NULL_PROXY; }
+    };
+
+    std::vector<Node> nodes;
+    int root;
+    int freeList;
+    unsigned int leaves;
+    float margin;
+    mutable std::vector<int> stack; // cull() traversal, kept to skip allocating
+
+    int allocate();
+    void release(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    int balance(int node);
+    void refitUp(int node);
+    void fatten(AABB &fat, const AABB &box, const vec3 &displacement) const;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+/*
+Lock free queue for exactly one producer thread and one consumer thread.
+
+The producer only writes tail, the consumer only writes head, each reads
+the other's with acquire so the slot contents written before a release
+store are visible. Head and tail sit on their own cache lines so the two
+threads don't fight over one line. Capacity is rounded up to a power of
+two, one push past it fails instead of blocking, callers decide how to
+wait.
+*/
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+        head = 0;
+        tail = 0;
+    }
+
+    // Producer thread only. False when full.
+    bool push(const T &value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask)
+            return false;
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only. False when empty.
+    bool pop(T &value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head; // next slot to pop
+    alignas(64) std::atomic<size_t> tail; // next slot to push
+};
+
+#endif
@@ -0,0 +1,474 @@
+#include "texture.h"
+#include "glstate.h"
+#include "vecmath.h" // for the VECMATH_SSE switch
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+
+// Decoding -------------------------------------------------------------------
+
+static bool decodeTga(const unsigned char *data, size_t size, Image &out) {
+    if (size < 18)
+        return false;
+    int idLength = data[0];
+    int colorMapType = data[1];
+    int type = data[2];
+    int width = data[12] | (data[13] << 8);
+    int height = data[14] | (data[15] << 8);
+    int bits = data[16];
+    bool topFirst = (data[17] & 0x20) != 0;
+    bool rle = type == 10 || type == 11;
+    bool gray = type == 3 || type == 11;
+    if (colorMapType != 0 || (type != 2 && type != 3 && type != 10 && type != 11))
+        return false;
+    if (width <= 0 || height <= 0 || (gray ? bits != 8 : (bits != 24 && bits != 32)))
+        return false;
+
+    int bpp = bits / 8;
+    const unsigned char *p = data + 18 + idLength;
+    const unsigned char *end = data + size;
+    out = Image(width, height);
+
+    // TGA stores BGR(A), one run or raw packet may cross rows.
+    size_t count = (size_t)width * height;
+    size_t i = 0;
+    while (i < count) {
+        size_t run = 1;
+        bool repeat = false;
+        if (rle) {
+            if (p >= end)
+                return false;
+            run = (*p & 0x7F) + 1;
+            repeat = (*p & 0x80) != 0;
+            p++;
+        } else {
+            run = count;
+        }
+        for (size_t k = 0; k < run && i < count; k++, i++) {
+            if (p + bpp > end)
+                return false;
+            size_t row = i / width, col = i % width;
+            int y = topFirst ? height - 1 - (int)row : (int)row;
+            unsigned char *dst = out.pixel((int)col, y);
+            if (gray) {
+                dst[0] = dst[1] = dst[2] = p[0];
+                dst[3] = 255;
+            } else {
+                dst[0] = p[2];
+                dst[1] = p[1];
+                dst[2] = p[0];
+                dst[3] = bpp == 4 ? p[3] : 255;
+            }
+            if (!repeat)
+                p += bpp;
+        }
+        if (repeat)
+            p += bpp;
+    }
+    return true;
+}
+
+// Header fields of a PNM file, skipping whitespace and # comments.
+static bool pnmNumber(const unsigned char *&p, const unsigned char *end, int &value) {
+    for (;;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            p++;
+        if (p < end && *p == '#') {
+            while (p < end && *p != '\n')
+                p++;
+            continue;
+        }
+        break;
+    }
+    if (p >= end || *p < '0' || *p > '9')
+        return false;
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+    return true;
+}
+
+static bool decodePnm(const unsigned char *data, size_t size, Image &out) {
+    if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6'))
+        return false;
+    bool gray = data[1] == '5';
+    const unsigned char *p = data + 2;
+    const unsigned char *end = data + size;
+    int width, height, maxValue;
+    if (!pnmNumber(p, end, width) || !pnmNumber(p, end, height) || !pnmNumber(p, end, maxValue))
+        return false;
+    if (width <= 0 || height <= 0 || maxValue <= 0 || maxValue > 255)
+        return false;
+    p++; // the single whitespace before the pixels
+
+    int bpp = gray ? 1 : 3;
+    if ((size_t)(end - p) < (size_t)width * height * bpp)
+        return false;
+    out = Image(width, height);
+    // PNM rows go top to bottom.
+    for (int row = 0; row < height; row++) {
+        unsigned char *dst = out.pixel(0, height - 1 - row);
+        for (int x = 0; x < width; x++, p += bpp, dst += 4) {
+            dst[0] = (unsigned char)(p[0] * 255 / maxValue);
+            dst[1] = (unsigned char)(p[gray ? 0 : 1] * 255 / maxValue);
+            dst[2] = (unsigned char)(p[gray ? 0 : 2] * 255 / maxValue);
+            dst[3] = 255;
+        }
+    }
+    return true;
+}
+
+bool decodeImage(const char *data, size_t size, Image &out) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    if (size >= 2 && bytes[0] == 'P')
+        return decodePnm(bytes, size, out);
+    return decodeTga(bytes, size, out);
+}
+
+// Mipmaps --------------------------------------------------------------------
+
+void downsample(const Image &src, Image &dst) {
+    int w = src.width > 1 ? src.width / 2 : 1;
+    int h = src.height > 1 ? src.height / 2 : 1;
+    dst = Image(w, h);
+    for (int y = 0; y < h; y++) {
+        // A 1 pixel tall or wide source averages with itself.
+        const unsigned char *row0 = src.pixel(0, src.height > 1 ? y * 2 : 0);
+        const unsigned char *row1 = src.pixel(0, src.height > 1 ? y * 2 + 1 : 0);
+        unsigned char *out = dst.pixel(0, y);
+        int x = 0;
+        int step = src.width > 1 ? 2 : 0;
+#if defined(VECMATH_SSE)
+        // 4 source pixels in, 2 out: widen to 16 bits, add the rows, add
+        // the pixel pairs, round and narrow.
+        if (step == 2) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i two = _mm_set1_epi16(2);
+            for (; x + 2 <= w; x += 2) {
+                __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+                __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+                sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+                _mm_storel_epi64((__m128i*)(out + x * 4), _mm_packus_epi16(sum, sum));
+            }
+        }
+#endif
+        for (; x < w; x++) {
+            const unsigned char *a = row0 + x * step * 4;
+            const unsigned char *b = row1 + x * step * 4;
+            int next = step ? 4 : 0;
+            for (int c = 0; c < 4; c++)
+                out[x * 4 + c] = (unsigned char)((a[c] + a[next + c] + b[c] + b[next + c] + 2) >> 2);
+        }
+    }
+}
+
+void buildMipChain(const Image &base, std::vector<Image> &levels) {
+    levels.clear();
+    // Sized up front, downsample() reads the previous level while writing
+    // the next.
+    int count = 0;
+    for (int w = base.width, h = base.height; w > 1 || h > 1; count++) {
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    levels.resize(count);
+    for (int i = 0; i < count; i++)
+        downsample(i == 0 ? base : levels[i - 1], levels[i]);
+}
+
+// Skyline packer -------------------------------------------------------------
+
+SkylinePacker::SkylinePacker(int width, int height) {
+    this->width = width;
+    this->height = height;
+    reset();
+}
+
+void SkylinePacker::reset() {
+    skyline.clear();
+    Segment floor = { 0, 0, width };
+    skyline.push_back(floor);
+    used = 0;
+}
+
+// y where a w x h rectangle starting at segment index would sit, -1 if
+// it runs off the right or top edge.
+int SkylinePacker::fit(size_t index, int w, int h) const {
+    int x = skyline[index].x;
+    if (x + w > width)
+        return -1;
+    int y = 0;
+    int left = w;
+    for (size_t i = index; left > 0; i++) {
+        if (skyline[i].y > y)
+            y = skyline[i].y;
+        if (y + h > height)
+            return -1;
+        left -= skyline[i].width;
+    }
+    return y;
+}
+
+bool SkylinePacker::insert(int w, int h, int &x, int &y) {
+    int bestTop = height + 1, bestWidth = width + 1;
+    size_t best = skyline.size();
+    for (size_t i = 0; i < skyline.size(); i++) {
+        int top = fit(i, w, h);
+        if (top < 0)
+            continue;
+        // Lowest top wins, then the narrowest segment (less waste).
+        if (top + h < bestTop || (top + h == bestTop && skyline[i].width < bestWidth)) {
+            bestTop = top + h;
+            bestWidth = skyline[i].width;
+            best = i;
+        }
+    }
+    if (best == skyline.size())
+        return false;
+
+    x = skyline[best].x;
+    y = bestTop - h;
+    Segment placed = { x, bestTop, w };
+    skyline.insert(skyline.begin() + best, placed);
+
+    // Cut away whatever the new segment now covers.
+    for (size_t i = best + 1; i < skyline.size(); ) {
+        int covered = skyline[best].x + skyline[best].width - skyline[i].x;
+        if (covered <= 0)
+            break;
+        skyline[i].x += covered;
+        skyline[i].width -= covered;
+        if (skyline[i].width > 0)
+            break;
+        skyline.erase(skyline.begin() + i);
+    }
+    // Merge neighbours at the same height.
+    for (size_t i = 0; i + 1 < skyline.size(); ) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        } else {
+            i++;
+        }
+    }
+    used += (long long)w * h;
+    return true;
+}
+
+// Assets ---------------------------------------------------------------------
+
+static bool readImage(const std::string &path, Image &out) {
+    std::string bytes;
+    if (!AssetLoader::readFile(path, bytes)) {
+        std::cout << "ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        return false;
+    }
+    if (!decodeImage(bytes.data(), bytes.size(), out)) {
+        std::cout << "ERROR::TEXTURE::UNSUPPORTED_FORMAT " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool TextureAsset::read() {
+    if (!readImage(path, base))
+        return false;
+    if (mipmaps)
+        buildMipChain(base, levels);
+    return true;
+}
+
+bool TextureAsset::create() {
+    return manager.createTexture(*this);
+}
+
+// Decode (unless generated), then copy into an image one pixel bigger on
+// every side, the border repeating the edge.
+bool SpriteAsset::read() {
+    Image source;
+    if (path.empty())
+        source = std::move(image);
+    else if (!readImage(path, source))
+        return false;
+    if (source.width <= 0 || source.height <= 0)
+        return false;
+
+    image = Image(source.width + 2, source.height + 2);
+    for (int y = 0; y < image.height; y++) {
+        int sy = y == 0 ? 0 : (y > source.height ? source.height - 1 : y - 1);
+        memcpy(image.pixel(1, y), source.pixel(0, sy), (size_t)source.width * 4);
+        memcpy(image.pixel(0, y), source.pixel(0, sy), 4);
+        memcpy(image.pixel(image.width - 1, y), source.pixel(source.width - 1, sy), 4);
+    }
+    return true;
+}
+
+bool SpriteAsset::create() {
+    return manager.packSprite(*this);
+}
+
+// Manager --------------------------------------------------------------------
+
+TextureManager::TextureManager(AssetLoader &loader) : loader(loader), uploadPool(64) {
+    bytesUploaded = 0;
+    uploadHead = NULL;
+    uploadTail = NULL;
+    queuedBytes = 0;
+    const unsigned char pixel[4] = { 255, 255, 255, 255 };
+    glGenTextures(1, &white);
+    GLState::bindTexture(0, GL_TEXTURE_2D, white);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    textures.push_back(white);
+}
+
+TextureManager::~TextureManager() {
+    while (uploadHead) {
+        Upload *next = uploadHead->next;
+        uploadPool.destroy(uploadHead);
+        uploadHead = next;
+    }
+    GLState::deleteTextures((int)textures.size(), textures.data());
+    for (Atlas *atlas : atlases)
+        delete atlas;
+}
+
+TextureHandle TextureManager::loadTexture(const std::string &path, bool mipmaps) {
+    TextureHandle asset = std::make_shared<TextureAsset>(*this, path, mipmaps);
+    loader.load(asset);
+    return asset;
+}
+
+SpriteHandle TextureManager::loadSprite(const std::string &path) {
+    SpriteHandle asset = std::make_shared<SpriteAsset>(*this, path);
+    loader.load(asset);
+    return asset;
+}
+
+SpriteHandle TextureManager::addSprite(Image &&image) {
+    SpriteHandle asset = std::make_shared<SpriteAsset>(*this, std::string());
+    asset->image = std::move(image);
+    loader.load(asset);
+    return asset;
+}
+
+void TextureManager::queueUpload(const std::shared_ptr<Asset> &owner, std::atomic<int> &pending, const Image &image,
+                                 unsigned int texture, int level, int x, int y) {
+    Upload *u = uploadPool.create();
+    u->owner = owner;
+    u->pending = &pending;
+    u->image = &image;
+    u->texture = texture;
+    u->level = level;
+    u->x = x;
+    u->y = y;
+    u->rowsDone = 0;
+    u->next = NULL;
+    pending++;
+    if (uploadTail)
+        uploadTail->next = u;
+    else
+        uploadHead = u;
+    uploadTail = u;
+    queuedBytes += image.pixels.size();
+}
+
+bool TextureManager::createTexture(TextureAsset &asset) {
+    asset.width = asset.base.width;
+    asset.height = asset.base.height;
+    int levelCount = 1 + (int)asset.levels.size();
+
+    // Storage for every level now, pixels come later through update().
+    glGenTextures(1, &asset.texture);
+    textures.push_back(asset.texture);
+    GLState::bindTexture(0, GL_TEXTURE_2D, asset.texture);
+    for (int level = 0; level < levelCount; level++) {
+        const Image &image = level == 0 ? asset.base : asset.levels[level - 1];
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    std::shared_ptr<Asset> owner = asset.shared_from_this();
+    // Smallest levels first, they're cheap and give something to look at.
+    for (int level = levelCount - 1; level >= 0; level--) {
+        const Image &image = level == 0 ? asset.base : asset.levels[level - 1];
+        queueUpload(owner, asset.pendingUploads, image, asset.texture, level, 0, 0);
+    }
+    return true;
+}
+
+bool TextureManager::packSprite(SpriteAsset &asset) {
+    const Image &image = asset.image;
+    if (image.width > ATLAS_SIZE || image.height > ATLAS_SIZE) {
+        std::cout << "ERROR::TEXTURE::SPRITE_TOO_BIG_FOR_ATLAS " << asset.path << std::endl;
+        return false;
+    }
+
+    int x = 0, y = 0;
+    Atlas *atlas = NULL;
+    for (Atlas *a : atlases) {
+        if (a->packer.insert(image.width, image.height, x, y)) {
+            atlas = a;
+            break;
+        }
+    }
+    if (!atlas) {
+        atlas = new Atlas();
+        glGenTextures(1, &atlas->texture);
+        textures.push_back(atlas->texture);
+        GLState::bindTexture(0, GL_TEXTURE_2D, atlas->texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        atlases.push_back(atlas);
+        atlas->packer.insert(image.width, image.height, x, y);
+    }
+
+    // uv covers the sprite without its border.
+    asset.texture = atlas->texture;
+    asset.uv[0] = (float)(x + 1) / ATLAS_SIZE;
+    asset.uv[1] = (float)(y + 1) / ATLAS_SIZE;
+    asset.uv[2] = (float)(x + image.width - 1) / ATLAS_SIZE;
+    asset.uv[3] = (float)(y + image.height - 1) / ATLAS_SIZE;
+    queueUpload(asset.shared_from_this(), asset.pendingUploads, image, atlas->texture, 0, x, y);
+    return true;
+}
+
+void TextureManager::update(size_t budgetBytes) {
+    size_t spent = 0;
+    while (uploadHead && spent < budgetBytes) {
+        Upload &u = *uploadHead;
+        const Image &image = *u.image;
+        size_t rowBytes = (size_t)image.width * 4;
+        // Whole rows, at least one so big rows still get through.
+        int rows = (int)((budgetBytes - spent) / rowBytes);
+        if (rows < 1)
+            rows = 1;
+        if (rows > image.height - u.rowsDone)
+            rows = image.height - u.rowsDone;
+
+        GLState::bindTexture(0, GL_TEXTURE_2D, u.texture);
+        glTexSubImage2D(GL_TEXTURE_2D, u.level, u.x, u.y + u.rowsDone, image.width, rows,
+                        GL_RGBA, GL_UNSIGNED_BYTE, image.pixel(0, u.rowsDone));
+        u.rowsDone += rows;
+        spent += rows * rowBytes;
+        queuedBytes -= rows * rowBytes;
+        bytesUploaded += rows * rowBytes;
+
+        if (u.rowsDone == image.height) {
+            (*u.pending)--;
+            uploadHead = u.next;
+            if (!uploadHead)
+                uploadTail = NULL;
+            uploadPool.destroy(&u);
+        }
+    }
+}
@@ -0,0 +1,194 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "loader.h"
+#include "memory.h"
+
+// RGBA8 pixels. Rows are in GL order, the first one is the bottom.
+struct Image {
+    int width, height;
+    std::vector<unsigned char> pixels;
+
+    Image() : width(0), height(0) {}
+    Image(int width, int height) : width(width), height(height), pixels((size_t)width * height * 4) {}
+    unsigned char *pixel(int x, int y) { return &pixels[((size_t)y * width + x) * 4]; }
+    const unsigned char *pixel(int x, int y) const { return &pixels[((size_t)y * width + x) * 4]; }
+};
+
+// TGA (true color or grayscale, raw or RLE, 8/24/32 bit) and binary
+// PPM/PGM (P6/P5). No outside decoder library, add formats here.
+bool decodeImage(const char *data, size_t size, Image &out);
+
+// Half size with a 2x2 box filter, SSE2 where available. Odd sizes round
+// down, 1 stays 1.
+void downsample(const Image &src, Image &dst);
+// Levels 1..n down to 1x1, levels[0] is the first one below base.
+void buildMipChain(const Image &base, std::vector<Image> &levels);
+
+/*
+Skyline rectangle packer for atlases. The free space is kept as the
+profile of everything placed so far (a list of horizontal segments), a
+new rectangle goes where its top ends up lowest. Fast and wastes little
+for sprites of similar size. Nothing is ever removed, reset() to start
+over.
+*/
+class SkylinePacker {
+public:
+    SkylinePacker(int width, int height);
+
+    // False when it doesn't fit anywhere.
+    bool insert(int w, int h, int &x, int &y);
+    void reset();
+    // Used area over total area.
+    float occupancy() const { return (float)used / ((float)width * height); }
+
+private:
+    struct Segment {
+        int x, y, width;
+    };
+    std::vector<Segment> skyline;
+    int width, height;
+    long long used;
+
+    int fit(size_t index, int w, int h) const;
+};
+
+class TextureManager;
+
+// A standalone texture, mipmapped by default.
+class TextureAsset : public Asset {
+public:
+    TextureAsset(TextureManager &manager, const std::string &path, bool mipmaps)
+        : manager(manager), path(path), mipmaps(mipmaps), texture(0), width(0), height(0), pendingUploads(0) {}
+
+    // Created and every level uploaded, safe to sample.
+    bool usable() const { return ready() && pendingUploads == 0; }
+
+    TextureManager &manager;
+    std::string path;
+    bool mipmaps;
+    unsigned int texture;
+    int width, height;
+    std::atomic<int> pendingUploads;
+
+protected:
+    friend class TextureManager;
+    Image base;
+    std::vector<Image> levels;
+    bool read();
+    bool create();
+};
+
+// A small image packed into one of the manager's atlases. uv is
+// (u0, v0, u1, v1) inside that atlas.
+class SpriteAsset : public Asset {
+public:
+    SpriteAsset(TextureManager &manager, const std::string &path)
+        : manager(manager), path(path), texture(0), pendingUploads(0) {}
+
+    bool usable() const { return ready() && pendingUploads == 0; }
+
+    TextureManager &manager;
+    std::string path;    // empty for generated sprites
+    unsigned int texture; // the atlas
+    float uv[4];
+    std::atomic<int> pendingUploads;
+
+protected:
+    friend class TextureManager;
+    Image image;         // padded copy, see read()
+    bool read();
+    bool create();
+};
+
+typedef std::shared_ptr<TextureAsset> TextureHandle;
+typedef std::shared_ptr<SpriteAsset> SpriteHandle;
+
+/*
+Textures and sprite atlases, built on AssetLoader.
+
+Decoding, mip generation and sprite edge padding run on the loader's
+worker threads. The GL step only allocates storage (or finds a spot in
+an atlas) and queues the pixels. update() then feeds them to
+glTexSubImage2D, at most budgetBytes per frame, a few rows at a time,
+so a big texture never causes a hitch. Assets keep their pixels alive
+until every row is up.
+
+Sprites go into ATLAS_SIZE square atlases with a skyline packer, a new
+atlas is opened when one is full. Each sprite gets its border pixels
+repeated once around it, so linear filtering doesn't pull in the
+neighbours. Atlases have no mipmaps.
+*/
+class TextureManager {
+public:
+    static const int ATLAS_SIZE = 2048;
+
+    explicit TextureManager(AssetLoader &loader);
+    ~TextureManager();
+
+    TextureHandle loadTexture(const std::string &path, bool mipmaps = true);
+    SpriteHandle loadSprite(const std::string &path);
+    // Generated on the CPU, takes the pixels.
+    SpriteHandle addSprite(Image &&image);
+
+    // GL thread, once per frame, after AssetLoader::update().
+    void update(size_t budgetBytes);
+
+    // 1x1 white, for drawing untextured with a textured shader.
+    unsigned int whiteTexture() const { return white; }
+
+    size_t pendingBytes() const { return queuedBytes; }
+    size_t atlasCount() const { return atlases.size(); }
+    float atlasOccupancy(size_t atlas) const { return atlases[atlas]->packer.occupancy(); }
+    unsigned long long bytesUploaded;
+
+private:
+    friend class TextureAsset;
+    friend class SpriteAsset;
+
+    struct Upload {
+        std::shared_ptr<Asset> owner;     // keeps pixels alive
+        std::atomic<int> *pending;        // owner's pendingUploads
+        const Image *image;
+        unsigned int texture;
+        int level, x, y;
+        int rowsDone;
+        Upload *next;
+    };
+
+    struct Atlas {
+        unsigned int texture;
+        SkylinePacker packer;
+        Atlas() : texture(0), packer(ATLAS_SIZE, ATLAS_SIZE) {}
+    };
+
+    AssetLoader &loader;
+    std::vector<Atlas*> atlases;
+    // FIFO of pooled nodes, so streaming in more textures later doesn't
+    // go to the heap per upload.
+    ObjectPool<Upload> uploadPool;
+    Upload *uploadHead, *uploadTail;
+    size_t queuedBytes;
+    unsigned int white;
+    // GL names are deleted with the manager, not the assets, whose last
+    // reference may go away on any thread.
+    std::vector<unsigned int> textures;
+
+    void queueUpload(const std::shared_ptr<Asset> &owner, std::atomic<int> &pending, const Image &image,
+                     unsigned int texture, int level, int x, int y);
+    bool createTexture(TextureAsset &asset);
+    bool packSprite(SpriteAsset &asset);
+
+    TextureManager(const TextureManager&) = delete;
+    TextureManager& operator=(const TextureManager&) = delete;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include "timestep.h"
+
+FixedTimestep::FixedTimestep(double tickRate, int maxTicksPerFrame, double maxFrameTime)
+    : dt(1.0 / tickRate) {
+    this->maxTicksPerFrame = maxTicksPerFrame;
+    this->maxFrameTime = maxFrameTime;
+    this->accumulator = 0.0;
+    this->lastTime = 0.0;
+    this->started = false;
+    this->ticks = 0;
+    this->droppedTicks = 0;
+}
+
+int FixedTimestep::advance(double now) {
+    if (!started) {
+        // First frame renders the initial state, one tick to get going.
+        started = true;
+        lastTime = now;
+        accumulator = dt;
+    }
+
+    double frameTime = now - lastTime;
+    lastTime = now;
+    if (frameTime > maxFrameTime)
+        frameTime = maxFrameTime;
+    if (frameTime < 0.0)
+        frameTime = 0.0;
+    accumulator += frameTime;
+
+    int n = (int)(accumulator / dt);
+    if (n > maxTicksPerFrame) {
+        // Can't keep up, keep the partial tick and drop the rest.
+        droppedTicks += n - maxTicksPerFrame;
+        accumulator -= (n - maxTicksPerFrame) * dt;
+        n = maxTicksPerFrame;
+    }
+    accumulator -= n * dt;
+    ticks += n;
+    return n;
+}
+
+float FixedTimestep::alpha() const {
+    return (float)(accumulator / dt);
+}
@@ -0,0 +1,41 @@
+#ifndef TIMESTEP_H
+#define TIMESTEP_H
+
+/*
+Fixed timestep accumulator, decouples simulation from the frame rate.
+
+Each frame, advance() takes the current time and says how many fixed
+ticks of simulation to run. Whatever is left over (less than one tick)
+stays in the accumulator, and alpha() tells the renderer how far between
+the previous and current simulation state it should draw.
+
+Spiral of death protection: a long frame (breakpoint, hitch, window
+drag) is clamped to maxFrameTime, and at most maxTicksPerFrame ticks run
+per frame. Time beyond that is dropped, the game slows down for a moment
+instead of trying to catch up forever.
+*/
+class FixedTimestep {
+public:
+    FixedTimestep(double tickRate = 60.0, int maxTicksPerFrame = 5, double maxFrameTime = 0.25);
+
+    // Returns the number of ticks to run this frame.
+    int advance(double now);
+    // 0..1, how far the render time is past the last tick.
+    float alpha() const;
+
+    // seconds per tick, pass this to the simulation
+    const double dt;
+
+    // stats
+    long long ticks;        // total ticks run
+    long long droppedTicks; // ticks skipped by the catch up limit
+
+private:
+    int maxTicksPerFrame;
+    double maxFrameTime;
+    double accumulator;
+    double lastTime;
+    bool started;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "uniforms.h"
+#include "glstate.h"
+
+#include <string.h>
+
+int uniformBlockBinding(const char *name, size_t *size) {
+    static const struct { const char *name; int binding; size_t size; } blocks[] = {
+        { "Frame", UBO_FRAME, sizeof(FrameUniforms) },
+        { "Material", UBO_MATERIAL, sizeof(MaterialUniforms) },
+        { "Object", UBO_OBJECT, sizeof(ObjectUniforms) },
+        { "Mesh", UBO_MESH, sizeof(MeshUniforms) },
+    };
+    for (const auto &b : blocks) {
+        if (strcmp(b.name, name) == 0) {
+            if (size)
+                *size = b.size;
+            return b.binding;
+        }
+    }
+    return -1;
+}
+
+UniformBuffer::UniformBuffer() {
+    this->id = 0;
+    this->size = 0;
+}
+
+UniformBuffer::~UniformBuffer() {
+    if (id)
+        GLState::deleteBuffers(1, &id);
+}
+
+void UniformBuffer::update(const void *data, size_t size) {
+    if (!id) {
+        glGenBuffers(1, &id);
+        this->size = size;
+        GLState::bindBuffer(GL_UNIFORM_BUFFER, id);
+        glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+        return;
+    }
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, id);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size < this->size ? size : this->size, data);
+}
+
+void UniformBuffer::bind(unsigned int binding) const {
+    GLState::bindBufferBase(GL_UNIFORM_BUFFER, binding, id);
+}
+
+UniformStream::UniformStream(size_t capacity, unsigned int frames)
+    : staging(capacity), ring(GL_UNIFORM_BUFFER, capacity * (frames ? frames : 1)) {
+    this->used = 0;
+    this->base = 0;
+    this->uploads = 0;
+    GLint align = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+    this->alignment = align > 0 ? (size_t)align : 256;
+}
+
+bool UniformStream::push(const void *data, size_t size, size_t &offset) {
+    size_t start = (used + alignment - 1) / alignment * alignment;
+    if (start + size > staging.size())
+        return false;
+    memcpy(&staging[start], data, size);
+    offset = start;
+    used = start + size;
+    return true;
+}
+
+void UniformStream::upload() {
+    if (used == 0)
+        return;
+    // Offsets from push() stay valid, the whole batch moves by base.
+    void *dst = ring.map(used, alignment, base);
+    if (dst) {
+        memcpy(dst, staging.data(), used);
+        ring.unmap();
+    } else {
+        GLState::bindBuffer(GL_UNIFORM_BUFFER, ring.buffer());
+        glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)base, (GLsizeiptr)used, staging.data());
+    }
+    uploads++;
+}
+
+void UniformStream::bind(unsigned int binding, size_t offset, size_t size) const {
+    GLState::bindBufferRange(GL_UNIFORM_BUFFER, binding, ring.buffer(), base + offset, size);
+}
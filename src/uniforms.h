@@ -0,0 +1,139 @@
+#ifndef UNIFORMS_H
+#define UNIFORMS_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+#include <vector>
+
+#include "uploadring.h"
+
+/*
+Uniform blocks shared by all programs, declared in shaders/uniforms.glsl.
+
+Each block has a fixed binding point. Shader binds blocks to them by
+name after every link, so a buffer bound once to UBO_FRAME is seen by
+every program that declares Frame, and switching programs doesn't
+mean setting anything again.
+
+  Frame     once per frame: camera, time, viewport
+  Material  per material, bound when the material changes
+  Object    per draw, one slot of a big UniformStream each
+  Mesh      per mesh, dequantization for meshdecode.glsl
+
+The structs below mirror the blocks in std140. Everything is vec4 or
+mat4 sized, so std140 has nothing to pad and the static_asserts only
+have to check offsets and sizes. Change both sides together, Shader
+also compares the sizes GL reports when linking.
+*/
+enum UniformBinding {
+    UBO_FRAME = 0,
+    UBO_MATERIAL = 1,
+    UBO_OBJECT = 2,
+    UBO_MESH = 3,
+    UBO_BINDING_COUNT
+};
+
+struct FrameUniforms {
+    float viewProjection[16]; // column major
+    float time[4];            // seconds, pulse (0..1), frame delta, unused
+    float viewport[4];        // width, height, 1 / width, 1 / height
+};
+
+struct MaterialUniforms {
+    float tint[4];            // multiplies texel * vertex color
+    float params[4];          // alpha cutoff, unused x3
+};
+
+struct ObjectUniforms {
+    float model[16];          // column major
+    float color[4];
+    float uvRect[4];          // u, v offset then width, height
+};
+
+struct MeshUniforms {
+    float positionScale[4];   // xyz, w = 1 for octahedral normals
+    float positionOffset[4];  // xyz
+    float uvTransform[4];     // offset u v, then scale u v
+};
+
+static_assert(offsetof(FrameUniforms, time) == 64, "FrameUniforms must match Frame in uniforms.glsl");
+static_assert(offsetof(FrameUniforms, viewport) == 80, "FrameUniforms must match Frame in uniforms.glsl");
+static_assert(sizeof(FrameUniforms) == 96, "FrameUniforms must match Frame in uniforms.glsl");
+static_assert(offsetof(MaterialUniforms, params) == 16, "MaterialUniforms must match Material in uniforms.glsl");
+static_assert(sizeof(MaterialUniforms) == 32, "MaterialUniforms must match Material in uniforms.glsl");
+static_assert(offsetof(ObjectUniforms, color) == 64, "ObjectUniforms must match Object in uniforms.glsl");
+static_assert(offsetof(ObjectUniforms, uvRect) == 80, "ObjectUniforms must match Object in uniforms.glsl");
+static_assert(sizeof(ObjectUniforms) == 96, "ObjectUniforms must match Object in uniforms.glsl");
+static_assert(offsetof(MeshUniforms, positionOffset) == 16, "MeshUniforms must match Mesh in uniforms.glsl");
+static_assert(offsetof(MeshUniforms, uvTransform) == 32, "MeshUniforms must match Mesh in uniforms.glsl");
+static_assert(sizeof(MeshUniforms) == 48, "MeshUniforms must match Mesh in uniforms.glsl");
+
+// Binding point and C++ size of a block by its GLSL name, -1 for names
+// that aren't ours.
+int uniformBlockBinding(const char *name, size_t *size);
+
+// A block's worth of data in its own buffer, for blocks written once or
+// rarely (a mesh's, a fixed material). update() writes in place, which
+// waits for draws still reading it, so blocks that change every frame
+// go in a UniformStream instead.
+class UniformBuffer {
+public:
+    UniformBuffer();
+    ~UniformBuffer();
+
+    // Allocates on first use, size can't change after that.
+    void update(const void *data, size_t size);
+    template <typename T>
+    void update(const T &block) { update(&block, sizeof(T)); }
+    void bind(unsigned int binding) const;
+
+    unsigned int id;
+
+private:
+    size_t size;
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+};
+
+/*
+Per draw and per frame blocks. push() copies a block into a CPU side staging area at
+the next offset GL allows for glBindBufferRange, upload() copies all of
+them into an UploadRing in one go, then bind() points a binding at one
+of them. endFrame() once the frame's draws are in fences what was
+uploaded, the ring holds frames of capacity bytes before it has to wait.
+
+When push() says it's full: upload(), draw what was pushed, reset() and
+carry on. Staging is allocated once, nothing per frame.
+*/
+class UniformStream {
+public:
+    explicit UniformStream(size_t capacity = 1 << 20, unsigned int frames = 3);
+
+    // Offset to bind later, false when there's no room left.
+    bool push(const void *data, size_t size, size_t &offset);
+    void upload();
+    void bind(unsigned int binding, size_t offset, size_t size) const;
+    // Where a pushed block ended up in buffer(), after upload().
+    size_t offset(size_t pushed) const { return base + pushed; }
+    void reset() { used = 0; }
+    void endFrame() { ring.endFrame(); }
+
+    size_t pushed() const { return used; }
+    unsigned int buffer() const { return ring.buffer(); }
+    const UploadRing::Stats &uploadStats() const { return ring.stats; }
+    unsigned long long uploads; // upload() calls, for the stats
+
+private:
+    std::vector<unsigned char> staging;
+    size_t used;
+    size_t alignment;   // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    UploadRing ring;
+    size_t base;        // where the last upload() went in the ring
+
+    UniformStream(const UniformStream&) = delete;
+    UniformStream& operator=(const UniformStream&) = delete;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "uploadring.h"
+#include "glad_ext.h"
+#include "glstate.h"
+
+#include <chrono>
+#include <iostream>
+
+bool UploadRing::allowPersistent = true;
+
+UploadRing::UploadRing(GLenum target, size_t size) {
+    this->bufferTarget = target;
+    this->size = size > 0 ? size : 1;
+    this->mapped = NULL;
+    this->mappedRange = false;
+    this->head = 0;
+    this->segmentBegin = 0;
+    this->segmentCount = 0;
+    this->stats.stalls = 0;
+    this->stats.stallMs = 0.0;
+    this->stats.bytes = 0;
+    this->stats.wraps = 0;
+
+    glGenBuffers(1, &id);
+    GLState::bindBuffer(target, id);
+    if (allowPersistent && GLAD_GL_ARB_buffer_storage) {
+        // Immutable storage, mapped for good. Coherent, so writes are seen
+        // by draws issued after them without flushing anything.
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, (GLsizeiptr)this->size, NULL, flags);
+        mapped = (unsigned char*)glMapBufferRange(target, 0, (GLsizeiptr)this->size, flags);
+        // Still writable through the fallback path.
+        if (!mapped)
+            std::cout << "ERROR::UPLOADRING::PERSISTENT_MAP_FAILED" << std::endl;
+    } else {
+        glBufferData(target, (GLsizeiptr)this->size, NULL, GL_STREAM_DRAW);
+    }
+}
+
+UploadRing::~UploadRing() {
+    if (mapped || mappedRange) {
+        GLState::bindBuffer(bufferTarget, id);
+        glUnmapBuffer(bufferTarget);
+    }
+    for (int i = 0; i < segmentCount; i++)
+        glDeleteSync(segments[i].fence);
+    GLState::deleteBuffers(1, &id);
+}
+
+void *UploadRing::map(size_t bytes, size_t align, size_t &offset) {
+    if (bytes > size)
+        return NULL;
+    if (mappedRange)
+        unmap();
+    if (align == 0)
+        align = 1;
+
+    size_t at = (size_t)(head % size);
+    size_t start = (at + align - 1) / align * align;
+    if (start + bytes > size) {
+        // Doesn't fit before the end, skip the tail and start over.
+        head += size - at;
+        start = 0;
+        stats.wraps++;
+    } else {
+        head += start - at;
+    }
+
+    // These bytes last held what was written one ring ago, everything
+    // before that has to be done on the GPU.
+    if (head + bytes > size)
+        waitFor(head + bytes - size);
+
+    offset = start;
+    head += bytes;
+    stats.bytes += bytes;
+    if (mapped)
+        return mapped + start;
+
+    // The fence already made sure nobody reads this range, so the driver
+    // doesn't need to check.
+    GLState::bindBuffer(bufferTarget, id);
+    void *dst = glMapBufferRange(bufferTarget, (GLintptr)start, (GLsizeiptr)bytes,
+                                 GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    mappedRange = dst != NULL;
+    return dst;
+}
+
+void UploadRing::unmap() {
+    if (!mappedRange)
+        return;
+    GLState::bindBuffer(bufferTarget, id);
+    if (!glUnmapBuffer(bufferTarget))
+        std::cout << "ERROR::UPLOADRING::UNMAP_FAILED" << std::endl;
+    mappedRange = false;
+}
+
+void UploadRing::endFrame() {
+    unmap();
+    fence();
+}
+
+void UploadRing::fence() {
+    if (head == segmentBegin)
+        return;
+    // Out of slots: the oldest is from frames ago, it's done by now (or
+    // it's about to be).
+    if (segmentCount == MAX_SEGMENTS)
+        waitFor(segments[0].end);
+    Segment &s = segments[segmentCount++];
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s.begin = segmentBegin;
+    s.end = head;
+    segmentBegin = head;
+}
+
+void UploadRing::waitFor(unsigned long long position) {
+    // Overwriting this frame's own data, fence it now and wait like for
+    // any other.
+    if (segmentBegin < position && head > segmentBegin) {
+        unmap();
+        fence();
+    }
+
+    int done = 0;
+    while (done < segmentCount && segments[done].begin < position) {
+        GLsync fence = segments[done].fence;
+        // Poll first, a frame ago is usually long finished.
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            do {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            } while (result == GL_TIMEOUT_EXPIRED);
+            std::chrono::duration<double, std::milli> waited = std::chrono::steady_clock::now() - start;
+            stats.stalls++;
+            stats.stallMs += waited.count();
+        }
+        if (result == GL_WAIT_FAILED)
+            std::cout << "ERROR::UPLOADRING::WAIT_FAILED" << std::endl;
+        glDeleteSync(fence);
+        done++;
+    }
+    if (done == 0)
+        return;
+    for (int i = done; i < segmentCount; i++)
+        segments[i - done] = segments[i];
+    segmentCount -= done;
+}
@@ -0,0 +1,86 @@
+#ifndef UPLOADRING_H
+#define UPLOADRING_H
+
+#include <glad/glad.h>
+
+#include <stddef.h>
+
+/*
+Streaming buffer for data written every frame (vertices, uniform
+blocks). One buffer used as a ring: map() hands out the next free bytes,
+endFrame() drops a fence (glFenceSync) after the frame's draws. Before
+map() writes over bytes from an earlier frame it waits on that frame's
+fence, so the GPU is never written under and the driver never has to
+guess. Size it for about three frames of data (triple buffering), then
+the fences are long signaled by the time they're checked and nothing
+waits.
+
+With ARB_buffer_storage the buffer is mapped once, persistent and
+coherent, and map() is pointer arithmetic. Without it every map() is a
+glMapBufferRange(UNSYNCHRONIZED | INVALIDATE_RANGE) of just that range,
+the fences are what makes unsynchronized safe. Either way no
+glBufferData after creation, so no reallocation and no implicit sync.
+
+A frame bigger than the whole ring waits on its own earlier draws
+(fenced on the spot), slow but correct, and it shows in the stats.
+
+One GL context, one thread.
+*/
+class UploadRing {
+public:
+    // Set false before creating rings to test the fallback path.
+    static bool allowPersistent;
+
+    UploadRing(GLenum target, size_t size);
+    ~UploadRing();
+
+    // Room for size bytes at an offset that's a multiple of align (any
+    // value, not just powers of two). NULL if size is more than the
+    // whole ring. Write, then unmap() before drawing from it.
+    void *map(size_t size, size_t align, size_t &offset);
+    void unmap();
+    // Fences everything mapped since the last call. Once per frame,
+    // after the draws that read it.
+    void endFrame();
+
+    unsigned int buffer() const { return id; }
+    GLenum target() const { return bufferTarget; }
+    size_t capacity() const { return size; }
+    bool persistent() const { return mapped != NULL; }
+
+    // Since creation.
+    struct Stats {
+        unsigned long long stalls;    // map() found the GPU still reading
+        double stallMs;               // time spent waiting in those
+        unsigned long long bytes;     // mapped in total
+        unsigned long long wraps;
+    };
+    Stats stats;
+
+private:
+    // A stretch of the ring, in absolute positions (never wrapped), and
+    // the fence that says the GPU is done with it.
+    struct Segment {
+        GLsync fence;
+        unsigned long long begin, end;
+    };
+    static const int MAX_SEGMENTS = 16;
+
+    unsigned int id;
+    GLenum bufferTarget;
+    size_t size;
+    unsigned char *mapped;            // persistent mapping, NULL when not
+    bool mappedRange;                 // fallback map() waiting for unmap()
+    unsigned long long head;          // next free absolute position
+    unsigned long long segmentBegin;  // start of what's not fenced yet
+    Segment segments[MAX_SEGMENTS];   // oldest first
+    int segmentCount;
+
+    void fence();
+    void waitFor(unsigned long long position);
+
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator=(const UploadRing&) = delete;
+};
+
+#endif
@@ -0,0 +1,284 @@
+#include "vecmath.h"
+
+#include <string.h>
+
+mat4 mat4::identity() {
+    mat4 r = {{ 1.0f, 0.0f, 0.0f, 0.0f,
+                0.0f, 1.0f, 0.0f, 0.0f,
+                0.0f, 0.0f, 1.0f, 0.0f,
+                0.0f, 0.0f, 0.0f, 1.0f }};
+    return r;
+}
+
+mat4 mat4::translate(const vec3 &t) {
+    mat4 r = identity();
+    r.m[12] = t.x;
+    r.m[13] = t.y;
+    r.m[14] = t.z;
+    return r;
+}
+
+mat4 mat4::scale(const vec3 &s) {
+    mat4 r = identity();
+    r.m[0] = s.x;
+    r.m[5] = s.y;
+    r.m[10] = s.z;
+    return r;
+}
+
+mat4 mat4::rotate(const quat &q) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    mat4 r = {{ 1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz),        2.0f * (xz - wy),        0.0f,
+                2.0f * (xy - wz),        1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx),        0.0f,
+                2.0f * (xz + wy),        2.0f * (yz - wx),        1.0f - 2.0f * (xx + yy), 0.0f,
+                0.0f,                    0.0f,                    0.0f,                    1.0f }};
+    return r;
+}
+
+mat4 mat4::perspective(float fovYRadians, float aspect, float zNear, float zFar) {
+    float f = 1.0f / tanf(fovYRadians * 0.5f);
+    mat4 r;
+    memset(r.m, 0, sizeof(r.m));
+    r.m[0] = f / aspect;
+    r.m[5] = f;
+    r.m[10] = (zFar + zNear) / (zNear - zFar);
+    r.m[11] = -1.0f;
+    r.m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+    return r;
+}
+
+mat4 mat4::ortho(float left, float right, float bottom, float top, float zNear, float zFar) {
+    mat4 r = identity();
+    r.m[0] = 2.0f / (right - left);
+    r.m[5] = 2.0f / (top - bottom);
+    r.m[10] = -2.0f / (zFar - zNear);
+    r.m[12] = -(right + left) / (right - left);
+    r.m[13] = -(top + bottom) / (top - bottom);
+    r.m[14] = -(zFar + zNear) / (zFar - zNear);
+    return r;
+}
+
+mat4 mat4::lookAt(const vec3 &eye, const vec3 &center, const vec3 &up) {
+    vec3 f = normalize(center - eye);
+    vec3 s = normalize(cross(f, up));
+    vec3 u = cross(s, f);
+    mat4 r = {{ s.x, u.x, -f.x, 0.0f,
+                s.y, u.y, -f.y, 0.0f,
+                s.z, u.z, -f.z, 0.0f,
+                -dot(s, eye), -dot(u, eye), dot(f, eye), 1.0f }};
+    return r;
+}
+
+quat quat::axisAngle(const vec3 &axis, float radians) {
+    vec3 a = normalize(axis);
+    float s = sinf(radians * 0.5f);
+    quat q = { a.x * s, a.y * s, a.z * s, cosf(radians * 0.5f) };
+    return q;
+}
+
+mat4 transpose(const mat4 &a) {
+    mat4 r;
+    for (int c = 0; c < 4; c++)
+        for (int row = 0; row < 4; row++)
+            r.m[row * 4 + c] = a.m[c * 4 + row];
+    return r;
+}
+
+// Cofactor expansion. Not hot, culling and cameras need it once a frame.
+mat4 inverse(const mat4 &a) {
+    const float *m = a.m;
+    float inv[16];
+    inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    if (det == 0.0f)
+        return mat4::identity();
+    float invDet = 1.0f / det;
+    mat4 r;
+    for (int i = 0; i < 16; i++)
+        r.m[i] = inv[i] * invDet;
+    return r;
+}
+
+mat3 normalMatrix(const mat4 &a) {
+    // Inverse transpose of the 3x3 is its cofactor matrix over the determinant.
+    const float *m = a.m;
+    float c00 = m[5] * m[10] - m[9] * m[6];
+    float c01 = m[8] * m[6] - m[4] * m[10];
+    float c02 = m[4] * m[9] - m[8] * m[5];
+    float det = m[0] * c00 + m[1] * c01 + m[2] * c02;
+    float inv = det != 0.0f ? 1.0f / det : 1.0f;
+    mat3 r = {{
+        c00 * inv, c01 * inv, c02 * inv,
+        (m[9] * m[2] - m[1] * m[10]) * inv, (m[0] * m[10] - m[8] * m[2]) * inv, (m[8] * m[1] - m[0] * m[9]) * inv,
+        (m[1] * m[6] - m[5] * m[2]) * inv, (m[4] * m[2] - m[0] * m[6]) * inv, (m[0] * m[5] - m[4] * m[1]) * inv
+    }};
+    return r;
+}
+
+quat slerp(const quat &a, const quat &b, float t) {
+    float cosTheta = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    quat end = b;
+    if (cosTheta < 0.0f) {
+        cosTheta = -cosTheta;
+        end.x = -b.x; end.y = -b.y; end.z = -b.z; end.w = -b.w;
+    }
+    float wa, wb;
+    if (cosTheta > 0.9995f) {
+        wa = 1.0f - t;
+        wb = t;
+    } else {
+        float theta = acosf(cosTheta);
+        float s = 1.0f / sinf(theta);
+        wa = sinf((1.0f - t) * theta) * s;
+        wb = sinf(t * theta) * s;
+    }
+    quat r = { a.x * wa + end.x * wb, a.y * wa + end.y * wb, a.z * wa + end.z * wb, a.w * wa + end.w * wb };
+    return normalize(r);
+}
+
+// Batched ---------------------------------------------------------------------
+
+#if defined(VECMATH_AVX2)
+#if defined(__FMA__)
+#define VECMATH_MADD256(a, b, c) _mm256_fmadd_ps(a, b, c)
+#else
+#define VECMATH_MADD256(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+#endif
+
+// Two columns of a * b at once. Each 128 bit lane holds one column of b,
+// permute broadcasts element k within each lane. mat4 is only 16 byte
+// aligned, so unaligned loads and stores.
+static inline void columnPair(const __m256 a[4], const float *b, float *out) {
+    __m256 cols = _mm256_loadu_ps(b);
+    __m256 r = _mm256_mul_ps(a[0], _mm256_permute_ps(cols, 0x00));
+    r = VECMATH_MADD256(a[1], _mm256_permute_ps(cols, 0x55), r);
+    r = VECMATH_MADD256(a[2], _mm256_permute_ps(cols, 0xAA), r);
+    r = VECMATH_MADD256(a[3], _mm256_permute_ps(cols, 0xFF), r);
+    _mm256_storeu_ps(out, r);
+}
+
+static inline void loadColumns(const mat4 &a, __m256 out[4]) {
+    for (int k = 0; k < 4; k++)
+        out[k] = _mm256_broadcast_ps((const __m128*)(a.m + k * 4));
+}
+#endif
+
+void transformPoints(const mat4 &m, const vec3 *in, vec3 *out, size_t count) {
+    size_t i = 0;
+#if defined(VECMATH_AVX2)
+    // Two points per iteration, one in each lane.
+    __m256 c[4];
+    loadColumns(m, c);
+    for (; i + 2 <= count; i += 2) {
+        vec3 p0 = in[i], p1 = in[i + 1];
+        __m256 r = VECMATH_MADD256(c[0], _mm256_setr_m128(_mm_set1_ps(p0.x), _mm_set1_ps(p1.x)), c[3]);
+        r = VECMATH_MADD256(c[1], _mm256_setr_m128(_mm_set1_ps(p0.y), _mm_set1_ps(p1.y)), r);
+        r = VECMATH_MADD256(c[2], _mm256_setr_m128(_mm_set1_ps(p0.z), _mm_set1_ps(p1.z)), r);
+        alignas(32) float v[8];
+        _mm256_store_ps(v, r);
+        out[i].x = v[0]; out[i].y = v[1]; out[i].z = v[2];
+        out[i + 1].x = v[4]; out[i + 1].y = v[5]; out[i + 1].z = v[6];
+    }
+#elif defined(VECMATH_SSE)
+    __m128 c0 = _mm_load_ps(m.m), c1 = _mm_load_ps(m.m + 4), c2 = _mm_load_ps(m.m + 8), c3 = _mm_load_ps(m.m + 12);
+    for (; i + 1 <= count; i++) {
+        vec3 p = in[i];
+        __m128 r = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p.x)), c3);
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(p.y)));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(p.z)));
+        alignas(16) float v[4];
+        _mm_store_ps(v, r);
+        out[i].x = v[0]; out[i].y = v[1]; out[i].z = v[2];
+    }
+#endif
+    for (; i < count; i++)
+        out[i] = transformPoint(m, in[i]);
+}
+
+void transformPoints(const mat4 &m, const vec4 *in, vec4 *out, size_t count) {
+    size_t i = 0;
+#if defined(VECMATH_AVX2)
+    __m256 c[4];
+    loadColumns(m, c);
+    for (; i + 2 <= count; i += 2)
+        columnPair(c, &in[i].x, &out[i].x);
+#endif
+    for (; i < count; i++)
+        out[i] = m * in[i];
+}
+
+void multiplyMatrices(const mat4 &a, const mat4 *b, mat4 *out, size_t count) {
+#if defined(VECMATH_AVX2)
+    __m256 c[4];
+    loadColumns(a, c);
+    for (size_t i = 0; i < count; i++) {
+        // b[i] may be out[i], both halves are read before either is written.
+        alignas(32) float tmp[16];
+        columnPair(c, b[i].m, tmp);
+        columnPair(c, b[i].m + 8, tmp + 8);
+        memcpy(out[i].m, tmp, sizeof(tmp));
+    }
+#else
+    for (size_t i = 0; i < count; i++)
+        out[i] = a * b[i];
+#endif
+}
+
+void multiplyMatrices(const mat4 *a, const mat4 *b, mat4 *out, size_t count) {
+#if defined(VECMATH_AVX2)
+    for (size_t i = 0; i < count; i++) {
+        __m256 c[4];
+        loadColumns(a[i], c);
+        alignas(32) float tmp[16];
+        columnPair(c, b[i].m, tmp);
+        columnPair(c, b[i].m + 8, tmp + 8);
+        memcpy(out[i].m, tmp, sizeof(tmp));
+    }
+#else
+    for (size_t i = 0; i < count; i++)
+        out[i] = a[i] * b[i];
+#endif
+}
+
+void composeTransforms(const vec3 *position, const quat *rotation, const vec3 *scale, mat4 *out, size_t count) {
+    // T * R * S written out, no products needed: the rotation columns
+    // scaled by s, the translation in the last column.
+    for (size_t i = 0; i < count; i++) {
+        mat4 r = mat4::rotate(rotation[i]);
+        const vec3 &s = scale[i];
+        const vec3 &t = position[i];
+        mat4 &o = out[i];
+        o.m[0] = r.m[0] * s.x; o.m[1] = r.m[1] * s.x; o.m[2] = r.m[2] * s.x;  o.m[3] = 0.0f;
+        o.m[4] = r.m[4] * s.y; o.m[5] = r.m[5] * s.y; o.m[6] = r.m[6] * s.y;  o.m[7] = 0.0f;
+        o.m[8] = r.m[8] * s.z; o.m[9] = r.m[9] * s.z; o.m[10] = r.m[10] * s.z; o.m[11] = 0.0f;
+        o.m[12] = t.x;         o.m[13] = t.y;         o.m[14] = t.z;           o.m[15] = 1.0f;
+    }
+}
+
+const char *vecmathPath() {
+#if defined(VECMATH_AVX2)
+    return "avx2";
+#elif defined(VECMATH_SSE)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
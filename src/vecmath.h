@@ -0,0 +1,217 @@
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include <math.h>
+#include <stddef.h>
+
+/*
+Vector, matrix and quaternion math, same conventions as GLSL: matrices
+are column major (m[col * 4 + row]) so data() goes straight into
+glUniformMatrix*fv / setMat4 with transpose = GL_FALSE, and mat * vec
+transforms a column vector.
+
+The SIMD path is picked at compile time:
+  AVX2 (-mavx2, or -march=native on a machine that has it) for the
+       batched functions, plus FMA when -mfma is on too
+  SSE  x86-64 always has SSE2, used for mat4 products and the rest of
+       the batched functions
+  scalar anywhere else, or with -DVECMATH_SCALAR to compare results
+Results agree to rounding, FMA skips one rounding step.
+
+The small vector types are plain structs on purpose, SSE on a single
+vec3 costs more in shuffles than it saves. Where SIMD pays off is
+4x4 products and whole arrays, see the batched functions at the bottom.
+*/
+#if !defined(VECMATH_SCALAR)
+#if defined(__AVX2__)
+#define VECMATH_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#define VECMATH_SSE 1
+#include <immintrin.h>
+#endif
+#endif
+
+struct vec2 {
+    float x, y;
+};
+
+struct vec3 {
+    float x, y, z;
+};
+
+struct alignas(16) vec4 {
+    float x, y, z, w;
+};
+
+struct quat;
+
+// Column major, 9 floats, for normal matrices.
+struct mat3 {
+    float m[9];
+    const float *data() const { return m; }
+};
+
+struct alignas(16) mat4 {
+    float m[16];
+    const float *data() const { return m; }
+
+    static mat4 identity();
+    static mat4 translate(const vec3 &t);
+    static mat4 scale(const vec3 &s);
+    static mat4 rotate(const quat &q);
+    // Right handed, depth -1..1 like glm and the GL defaults.
+    static mat4 perspective(float fovYRadians, float aspect, float zNear, float zFar);
+    static mat4 ortho(float left, float right, float bottom, float top, float zNear, float zFar);
+    static mat4 lookAt(const vec3 &eye, const vec3 &center, const vec3 &up);
+};
+
+// Rotation, x y z is the vector part. Keep it unit length.
+struct alignas(16) quat {
+    float x, y, z, w;
+
+    static quat identity() { quat q = { 0.0f, 0.0f, 0.0f, 1.0f }; return q; }
+    static quat axisAngle(const vec3 &axis, float radians);
+};
+
+// vec2 ----------------------------------------------------------------------
+
+inline vec2 operator+(const vec2 &a, const vec2 &b) { vec2 r = { a.x + b.x, a.y + b.y }; return r; }
+inline vec2 operator-(const vec2 &a, const vec2 &b) { vec2 r = { a.x - b.x, a.y - b.y }; return r; }
+inline vec2 operator*(const vec2 &a, float s) { vec2 r = { a.x * s, a.y * s }; return r; }
+inline float dot(const vec2 &a, const vec2 &b) { return a.x * b.x + a.y * b.y; }
+inline float length(const vec2 &a) { return sqrtf(dot(a, a)); }
+
+// vec3 ----------------------------------------------------------------------
+
+inline vec3 operator+(const vec3 &a, const vec3 &b) { vec3 r = { a.x + b.x, a.y + b.y, a.z + b.z }; return r; }
+inline vec3 operator-(const vec3 &a, const vec3 &b) { vec3 r = { a.x - b.x, a.y - b.y, a.z - b.z }; return r; }
+inline vec3 operator-(const vec3 &a) { vec3 r = { -a.x, -a.y, -a.z }; return r; }
+inline vec3 operator*(const vec3 &a, float s) { vec3 r = { a.x * s, a.y * s, a.z * s }; return r; }
+inline vec3 operator*(const vec3 &a, const vec3 &b) { vec3 r = { a.x * b.x, a.y * b.y, a.z * b.z }; return r; }
+inline float dot(const vec3 &a, const vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline vec3 cross(const vec3 &a, const vec3 &b) {
+    vec3 r = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    return r;
+}
+inline float length(const vec3 &a) { return sqrtf(dot(a, a)); }
+// Zero stays zero instead of turning into NaNs.
+inline vec3 normalize(const vec3 &a) {
+    float len = length(a);
+    return len > 0.0f ? a * (1.0f / len) : a;
+}
+inline vec3 lerp(const vec3 &a, const vec3 &b, float t) { return a + (b - a) * t; }
+
+// vec4 ----------------------------------------------------------------------
+
+inline vec4 operator+(const vec4 &a, const vec4 &b) { vec4 r = { a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w }; return r; }
+inline vec4 operator-(const vec4 &a, const vec4 &b) { vec4 r = { a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w }; return r; }
+inline vec4 operator*(const vec4 &a, float s) { vec4 r = { a.x * s, a.y * s, a.z * s, a.w * s }; return r; }
+inline float dot(const vec4 &a, const vec4 &b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+// mat4 ----------------------------------------------------------------------
+
+#if defined(VECMATH_SSE)
+// r = sum over k of a.column(k) * b[k], for one column b of the right side.
+inline __m128 vecmathColumn(const float *a, const float *b) {
+    __m128 r = _mm_mul_ps(_mm_load_ps(a), _mm_set1_ps(b[0]));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(a + 4), _mm_set1_ps(b[1])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(a + 8), _mm_set1_ps(b[2])));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(a + 12), _mm_set1_ps(b[3])));
+    return r;
+}
+#endif
+
+inline mat4 operator*(const mat4 &a, const mat4 &b) {
+    mat4 r;
+#if defined(VECMATH_SSE)
+    for (int c = 0; c < 4; c++)
+        _mm_store_ps(r.m + c * 4, vecmathColumn(a.m, b.m + c * 4));
+#else
+    for (int c = 0; c < 4; c++)
+        for (int row = 0; row < 4; row++)
+            r.m[c * 4 + row] = a.m[row] * b.m[c * 4] + a.m[4 + row] * b.m[c * 4 + 1]
+                             + a.m[8 + row] * b.m[c * 4 + 2] + a.m[12 + row] * b.m[c * 4 + 3];
+#endif
+    return r;
+}
+
+inline vec4 operator*(const mat4 &a, const vec4 &v) {
+    vec4 r;
+#if defined(VECMATH_SSE)
+    _mm_store_ps(&r.x, vecmathColumn(a.m, &v.x));
+#else
+    r.x = a.m[0] * v.x + a.m[4] * v.y + a.m[8] * v.z + a.m[12] * v.w;
+    r.y = a.m[1] * v.x + a.m[5] * v.y + a.m[9] * v.z + a.m[13] * v.w;
+    r.z = a.m[2] * v.x + a.m[6] * v.y + a.m[10] * v.z + a.m[14] * v.w;
+    r.w = a.m[3] * v.x + a.m[7] * v.y + a.m[11] * v.z + a.m[15] * v.w;
+#endif
+    return r;
+}
+
+// Point, w = 1, no divide.
+inline vec3 transformPoint(const mat4 &a, const vec3 &p) {
+    vec4 v = { p.x, p.y, p.z, 1.0f };
+    vec4 r = a * v;
+    vec3 out = { r.x, r.y, r.z };
+    return out;
+}
+
+mat4 transpose(const mat4 &a);
+// General inverse. Singular matrices give the identity back.
+mat4 inverse(const mat4 &a);
+// Inverse transpose of the upper 3x3, for normals.
+mat3 normalMatrix(const mat4 &a);
+
+// quat ----------------------------------------------------------------------
+
+inline quat operator*(const quat &a, const quat &b) {
+    quat r = {
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+    };
+    return r;
+}
+
+inline quat conjugate(const quat &q) { quat r = { -q.x, -q.y, -q.z, q.w }; return r; }
+
+inline quat normalize(const quat &q) {
+    float len = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    if (len <= 0.0f)
+        return quat::identity();
+    float inv = 1.0f / len;
+    quat r = { q.x * inv, q.y * inv, q.z * inv, q.w * inv };
+    return r;
+}
+
+// v' = q v q*, expanded.
+inline vec3 rotate(const quat &q, const vec3 &v) {
+    vec3 u = { q.x, q.y, q.z };
+    vec3 t = cross(u, v) * 2.0f;
+    return v + t * q.w + cross(u, t);
+}
+
+// Shortest path, falls back to nlerp when the two are nearly equal.
+quat slerp(const quat &a, const quat &b, float t);
+
+// Batched --------------------------------------------------------------------
+// The hot loops. Arrays may not overlap unless noted. mat4 arrays must be
+// 16 byte aligned, which new and std::vector give you for mat4.
+
+// out[i] = m * (in[i], 1). in and out may be the same array.
+void transformPoints(const mat4 &m, const vec3 *in, vec3 *out, size_t count);
+// out[i] = m * in[i]. in and out may be the same array.
+void transformPoints(const mat4 &m, const vec4 *in, vec4 *out, size_t count);
+// out[i] = a * b[i], e.g. viewProjection times every model matrix.
+void multiplyMatrices(const mat4 &a, const mat4 *b, mat4 *out, size_t count);
+// out[i] = a[i] * b[i], e.g. parent world times local.
+void multiplyMatrices(const mat4 *a, const mat4 *b, mat4 *out, size_t count);
+// out[i] = translate(position[i]) * rotate(rotation[i]) * scale(scale[i]).
+void composeTransforms(const vec3 *position, const quat *rotation, const vec3 *scale, mat4 *out, size_t count);
+
+// Which path this build uses: "avx2", "sse" or "scalar".
+const char *vecmathPath();
+
+#endif
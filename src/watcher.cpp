@@ -0,0 +1,124 @@
+#include "watcher.h"
+#include "glad_ext.h"
+
+#include <iostream>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Both sources of a shader, read again after an edit. No GL step, the
+// compile goes through Shader::beginReload().
+class ReloadSources : public Asset {
+public:
+    ReloadSources(const std::string &vertexPath, const std::string &fragmentPath)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath) {}
+    std::string vertexPath, fragmentPath;
+    std::string vertexCode, fragmentCode;
+protected:
+    bool read() {
+        return Shader::preprocess(vertexPath, vertexCode)
+            && Shader::preprocess(fragmentPath, fragmentCode);
+    }
+};
+
+static std::string directoryOf(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+ShaderWatcher::ShaderWatcher(AssetLoader &loader) : loader(loader) {
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        std::cout << "ERROR::WATCHER::INOTIFY_INIT_FAILED" << std::endl;
+
+    // Let the driver use as many compiler threads as it likes.
+    if (GLAD_GL_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+}
+
+ShaderWatcher::~ShaderWatcher() {
+    if (fd >= 0)
+        close(fd);
+}
+
+void ShaderWatcher::watch(const ShaderHandle &shader) {
+    if (fd < 0)
+        return;
+
+    Entry entry;
+    entry.shader = shader;
+    entry.dirs[0] = directoryOf(shader->vertexPath);
+    entry.dirs[1] = directoryOf(shader->fragmentPath);
+    entry.dirty = false;
+    entries.push_back(entry);
+
+    for (const std::string &dir : entry.dirs) {
+        // Same directory twice gives back the same descriptor.
+        int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0)
+            std::cout << "ERROR::WATCHER::CANNOT_WATCH " << dir << std::endl;
+        else
+            watches[wd] = dir;
+    }
+}
+
+void ShaderWatcher::startRead(Entry &entry) {
+    entry.sources = std::make_shared<ReloadSources>(entry.shader->vertexPath, entry.shader->fragmentPath);
+    entry.dirty = false;
+    loader.load(entry.sources);
+}
+
+void ShaderWatcher::changed(const std::string &dir) {
+    for (Entry &entry : entries) {
+        if (entry.dirs[0] != dir && entry.dirs[1] != dir)
+            continue;
+        // Editors write more than once per save, one read at a time.
+        if (entry.sources)
+            entry.dirty = true;
+        else
+            startRead(entry);
+    }
+}
+
+void ShaderWatcher::update() {
+    if (fd < 0)
+        return;
+
+    // Drain the events that are already there, read() returns -1 with
+    // EAGAIN as soon as there are none.
+    alignas(struct inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+        for (char *p = buffer; p < buffer + length; ) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            std::map<int, std::string>::iterator it = watches.find(event->wd);
+            if (it != watches.end() && event->len > 0 && event->name[0] != '.')
+                changed(it->second);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    for (Entry &entry : entries) {
+        if (entry.sources && entry.sources->done()) {
+            std::shared_ptr<ReloadSources> sources = std::static_pointer_cast<ReloadSources>(entry.sources);
+            entry.sources.reset();
+            if (sources->ready())
+                entry.shader->shader.beginReload(sources->vertexCode, sources->fragmentCode);
+            if (entry.dirty)
+                startRead(entry);
+        }
+
+        switch (entry.shader->shader.pollReload()) {
+        case Shader::RELOAD_SWAPPED:
+            std::cout << "Reloaded " << entry.shader->vertexPath << " + " << entry.shader->fragmentPath << std::endl;
+            break;
+        case Shader::RELOAD_FAILED:
+            std::cout << "Reload failed, keeping the old program: " << entry.shader->vertexPath
+                      << " + " << entry.shader->fragmentPath << std::endl;
+            break;
+        default:
+            break;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "loader.h"
+
+/*
+Shader hot reload driven by inotify.
+
+Watches the directories of every registered shader. When a file in one
+of them is written (or renamed into place, which is what rsync and most
+editors do), every shader from that directory is reloaded. That way an
+edit to an #include'd file is picked up too.
+
+Nothing in update() waits: the inotify fd is non blocking, new sources
+are read and preprocessed on the AssetLoader workers, compiling goes
+through Shader::beginReload()/pollReload(), which with
+KHR_parallel_shader_compile runs in the driver's own threads. The old
+program keeps drawing until the new one has linked.
+
+Linux only, watch() does nothing if inotify isn't available.
+*/
+class ShaderWatcher {
+public:
+    explicit ShaderWatcher(AssetLoader &loader);
+    ~ShaderWatcher();
+
+    void watch(const ShaderHandle &shader);
+    // GL thread, once per frame, after AssetLoader::update().
+    void update();
+
+private:
+    struct Entry {
+        ShaderHandle shader;
+        std::string dirs[2];               // vertex and fragment directory
+        std::shared_ptr<Asset> sources;    // new sources being read, or null
+        bool dirty;                        // changed again while reading
+    };
+
+    AssetLoader &loader;
+    int fd;
+    std::map<int, std::string> watches;    // inotify watch descriptor -> directory
+    std::vector<Entry> entries;
+
+    void changed(const std::string &dir);
+    void startRead(Entry &entry);
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+};
+
+#endif
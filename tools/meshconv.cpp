@@ -0,0 +1,209 @@
+// Converts OBJ meshes to the binary .mesh format, see src/meshfile.h.
+//
+//   meshconv [--float] [--no-optimize] [--no-overdraw] out.mesh lod0.obj [lod1.obj ...]
+//
+// Each input becomes one LOD, most detailed first. Triangles and
+// vertices are reordered for the GPU caches (see src/meshopt.h) unless
+// --no-optimize, ACMR is printed before and after each pass. Vertices
+// are quantized to 16 bytes unless --float keeps 32 bit floats. Faces
+// with more than three corners are split as fans, missing normals are
+// computed (smooth, area weighted), missing texture coordinates are 0.
+// Materials, groups and smoothing groups are ignored.
+
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/meshfile.h"
+#include "../src/meshopt.h"
+
+// One face corner, indices into the OBJ arrays, -1 when not given.
+struct Corner {
+    int v, vt, vn;
+    bool operator==(const Corner &o) const { return v == o.v && vt == o.vt && vn == o.vn; }
+};
+
+struct CornerHash {
+    size_t operator()(const Corner &c) const {
+        return ((size_t)c.v * 73856093u) ^ ((size_t)c.vt * 19349663u) ^ ((size_t)c.vn * 83492791u);
+    }
+};
+
+// OBJ indices start at 1, negative ones count back from the end.
+static int resolve(const std::string &field, size_t count) {
+    if (field.empty())
+        return -1;
+    int i = atoi(field.c_str());
+    if (i < 0)
+        i += (int)count;
+    else
+        i -= 1;
+    return i >= 0 && (size_t)i < count ? i : -2;
+}
+
+static bool loadObj(const std::string &path, MeshData &mesh) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "ERROR::MESHCONV::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+        return false;
+    }
+
+    std::vector<float> positions, uvs, normals;
+    std::vector<int> positionOf; // per output vertex, for computing normals
+    std::unordered_map<Corner, uint32_t, CornerHash> vertexOf;
+    bool missingNormals = false;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::istringstream in(line);
+        std::string type;
+        in >> type;
+        if (type == "v") {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            in >> x >> y >> z;
+            positions.insert(positions.end(), { x, y, z });
+        } else if (type == "vt") {
+            float u = 0.0f, v = 0.0f;
+            in >> u >> v;
+            uvs.insert(uvs.end(), { u, v });
+        } else if (type == "vn") {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            in >> x >> y >> z;
+            normals.insert(normals.end(), { x, y, z });
+        } else if (type == "f") {
+            std::vector<uint32_t> face;
+            std::string token;
+            while (in >> token) {
+                // v, v/vt, v//vn or v/vt/vn
+                std::string fields[3];
+                size_t start = 0;
+                for (int k = 0; k < 3; k++) {
+                    size_t slash = token.find('/', start);
+                    fields[k] = token.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+                    if (slash == std::string::npos)
+                        break;
+                    start = slash + 1;
+                }
+                Corner c = { resolve(fields[0], positions.size() / 3), resolve(fields[1], uvs.size() / 2),
+                             resolve(fields[2], normals.size() / 3) };
+                if (c.v < 0 || c.vt == -2 || c.vn == -2) {
+                    std::cout << "ERROR::MESHCONV::BAD_INDEX " << path << ":" << lineNumber << std::endl;
+                    return false;
+                }
+                if (c.vn < 0)
+                    missingNormals = true;
+
+                auto found = vertexOf.find(c);
+                if (found == vertexOf.end()) {
+                    MeshFileVertex v = {};
+                    for (int k = 0; k < 3; k++)
+                        v.position[k] = positions[c.v * 3 + k];
+                    if (c.vn >= 0)
+                        for (int k = 0; k < 3; k++)
+                            v.normal[k] = normals[c.vn * 3 + k];
+                    if (c.vt >= 0) {
+                        v.uv[0] = uvs[c.vt * 2];
+                        v.uv[1] = uvs[c.vt * 2 + 1];
+                    }
+                    found = vertexOf.emplace(c, (uint32_t)mesh.vertices.size()).first;
+                    mesh.vertices.push_back(v);
+                    positionOf.push_back(c.v);
+                }
+                face.push_back(found->second);
+            }
+            for (size_t k = 2; k < face.size(); k++)
+                mesh.indices.insert(mesh.indices.end(), { face[0], face[k - 1], face[k] });
+        }
+    }
+
+    if (missingNormals) {
+        // Sum the face normals (their length is twice the area) per
+        // position, so corners that share a position come out smooth.
+        std::vector<float> sums(positions.size(), 0.0f);
+        for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+            const float *a = mesh.vertices[mesh.indices[t]].position;
+            const float *b = mesh.vertices[mesh.indices[t + 1]].position;
+            const float *c = mesh.vertices[mesh.indices[t + 2]].position;
+            float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            for (int corner = 0; corner < 3; corner++)
+                for (int k = 0; k < 3; k++)
+                    sums[positionOf[mesh.indices[t + corner]] * 3 + k] += n[k];
+        }
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+            MeshFileVertex &v = mesh.vertices[i];
+            if (v.normal[0] != 0.0f || v.normal[1] != 0.0f || v.normal[2] != 0.0f)
+                continue;
+            const float *n = &sums[positionOf[i] * 3];
+            float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3 && len > 0.0f; k++)
+                v.normal[k] = n[k] / len;
+        }
+    }
+
+    if (mesh.indices.empty()) {
+        std::cout << "ERROR::MESHCONV::NO_FACES " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    bool optimize = true, overdraw = true;
+    MeshVertexFormat format = MESH_VERTEX_PACKED;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--float")
+            format = MESH_VERTEX_PNT;
+        else if (arg == "--no-optimize")
+            optimize = false;
+        else if (arg == "--no-overdraw")
+            overdraw = false;
+        else
+            files.push_back(arg);
+    }
+    if (files.size() < 2) {
+        std::cout << "usage: meshconv [--float] [--no-optimize] [--no-overdraw] out.mesh lod0.obj [lod1.obj ...]" << std::endl;
+        return 1;
+    }
+
+    std::vector<MeshData> lods(files.size() - 1);
+    for (size_t i = 0; i < lods.size(); i++) {
+        MeshData &mesh = lods[i];
+        if (!loadObj(files[i + 1], mesh))
+            return 1;
+        if (optimize) {
+            // The passes of optimizeMesh() one by one, to see what each buys.
+            std::cout << files[i + 1] << ": ACMR " << meshACMR(mesh.indices, mesh.vertices.size());
+            optimizeVertexCache(mesh.indices, mesh.vertices.size());
+            std::cout << ", vertex cache " << meshACMR(mesh.indices, mesh.vertices.size());
+            if (overdraw) {
+                optimizeOverdraw(mesh.indices, mesh.vertices);
+                std::cout << ", overdraw " << meshACMR(mesh.indices, mesh.vertices.size());
+            }
+            std::cout << std::endl;
+            // Drops vertices nothing uses, so sizes are printed after.
+            optimizeVertexFetch(mesh);
+        }
+        std::cout << files[i + 1] << ": LOD " << i << ", " << mesh.vertices.size() << " vertices, "
+                  << mesh.indices.size() / 3 << " triangles, "
+                  << (mesh.vertices.size() <= 65536 ? 16 : 32) << " bit indices" << std::endl;
+    }
+    if (!writeMeshFile(files[0], lods, format))
+        return 1;
+    size_t vertexCount = 0;
+    for (const MeshData &mesh : lods)
+        vertexCount += mesh.vertices.size();
+    std::cout << "vertex data: " << vertexCount * sizeof(MeshFileVertex) << " bytes as floats, "
+              << vertexCount * (format == MESH_VERTEX_PACKED ? sizeof(MeshPackedVertex) : sizeof(MeshFileVertex))
+              << " written" << std::endl;
+    return 0;
+}